@@ -73,7 +73,7 @@ echo ""
 msg_start "Installing X11 and desktop dependencies..."
 pacman -S --needed --noconfirm \
     xorg-server xorg-xinit xorg-xrandr xorg-xsetroot \
-    libx11 libxft libxinerama libxrender \
+    libx11 libxft libxinerama libxrandr libxrender \
     fontconfig freetype2 harfbuzz
 msg "X11 dependencies installed"
 
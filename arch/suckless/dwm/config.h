@@ -12,12 +12,15 @@
  *   06-colorbar       -- Per-element bar color schemes
  *   07-statuscmd      -- Clickable status bar blocks (dwmblocks integration)
  *   08-xrdb           -- Runtime color reload from X resources (applied via sed in setup.sh)
+ *   09-ipc            -- Control socket for scripts and bars (ipc.c)
+ *   10-stpool         -- Spare st instances on a hidden tag for instant terminals
  *
  * Keybindings (Alt = MODKEY):
  *   Alt+hjkl            focus windows
  *   Alt+Shift+hjkl      move/resize windows
  *   Alt+Space            launcher (dmenu)
- *   Alt+Enter            terminal (st)
+ *   Alt+Enter            terminal (st, taken from the spare pool when ready)
+ *   Alt+grave            show/hide the scratchpad terminal
  *   Alt+b                browser (firefox)
  *   Alt+w                wallpaper selector (set-wallpaper)
  *   Alt+F5               reload colors from xrdb
@@ -39,6 +42,10 @@
 /* appearance */
 static const unsigned int borderpx  = 2;        /* border pixel of windows */
 static const unsigned int snap      = 16;       /* snap pixel */
+static const int refreshrate        = 60;       /* mouse move/resize rate (Hz) when RandR can't tell */
+static const int screensettle       = 150;      /* ms to wait for rotation/hotplug events to settle */
+static const int synctimeout        = 100;      /* ms to wait for a client to paint a resize */
+static const int hiddenunmap        = 0;        /* 1 means unmap clients on hidden tags (IconicState) instead of moving them off screen */
 
 /* vanitygaps: gap settings (smaller for mobile screens) */
 static const unsigned int gappih    = 10;       /* horiz inner gap between windows */
@@ -94,6 +101,7 @@ static const char *tags[] = { "1", "2", "3", "4", "5", "6", "7", "8", "9" };
 static const Rule rules[] = {
 	/* class      instance    title       tags mask  isfloating  isterminal  noswallow  monitor */
 	{ "St",       NULL,       NULL,       0,         0,          1,          0,         -1 },
+	{ "St",       "stpool",   NULL,       POOLTAG,   0,          1,          0,         -1 },
 	{ "Firefox",  NULL,       NULL,       1 << 1,    0,          0,          0,         -1 },
 };
 
@@ -139,6 +147,11 @@ static const char *dmenucmd[]  = { "dmenu_run", "-m", dmenumon, "-fn", dmenufont
 static const char *termcmd[]   = { "st", NULL };
 static const char *browsercmd[] = { "firefox", NULL };
 
+/* stpool: spare terminals started ahead of time on a hidden tag, kept
+ * mapped off screen even with hiddenunmap */
+static const int stpoolsize    = 1;    /* spares kept running, 0 disables the pool */
+static const char *stpoolcmd[] = { "st", "-n", "stpool", NULL };
+
 /* custom function: tag window and follow focus */
 static void tagandview(const Arg *arg) {
 	if (arg->ui & TAGMASK) {
@@ -152,7 +165,8 @@ static const Key keys[] = {
 
 	/* launchers */
 	{ MODKEY,                       XK_space,  spawn,          {.v = dmenucmd } },
-	{ MODKEY,                       XK_Return, spawn,          {.v = termcmd } },
+	{ MODKEY,                       XK_Return, spawnterm,      {.v = termcmd } },
+	{ MODKEY,                       XK_grave,  togglescratch,  {0} },
 	{ MODKEY,                       XK_b,      spawn,          {.v = browsercmd } },
 	{ MODKEY,                       XK_w,      spawn,          SHCMD("set-wallpaper") },
 
@@ -243,3 +257,43 @@ static const Button buttons[] = {
 	{ ClkTagBar,            MODKEY,         Button1,        tag,            {0} },
 	{ ClkTagBar,            MODKEY,         Button3,        toggletag,      {0} },
 };
+
+/* ipc: control socket, see ipc.c for the protocol */
+static const char ipcsockpath[] = "/tmp/dwm.sock";
+
+/* record: "run record" toggles writing handled X events here, replay them
+ * with "dwm -r <file>" on an idle X server, see record.c */
+static const char recordpath[] = "/tmp/dwm.rec";
+
+/* timeline: where SIGUSR1 writes the trace of a -DTIMELINE build */
+static const char timelinepath[] = "/tmp/dwm-timeline.json";
+
+/* functions that can be run with "run <name> [argument]"; tag arguments are
+ * bitmasks, layout arguments are indices into layouts[] */
+static const IPCCommand ipccommands[] = {
+	/* name             function        argument */
+	{ "view",           view,           IPCArgUint },
+	{ "toggleview",     toggleview,     IPCArgUint },
+	{ "tag",            tag,            IPCArgUint },
+	{ "toggletag",      toggletag,      IPCArgUint },
+	{ "tagandview",     tagandview,     IPCArgUint },
+	{ "focusstack",     focusstack,     IPCArgInt },
+	{ "focusmon",       focusmon,       IPCArgInt },
+	{ "tagmon",         tagmon,         IPCArgInt },
+	{ "pushdown",       pushdown,       IPCArgNone },
+	{ "pushup",         pushup,         IPCArgNone },
+	{ "zoom",           zoom,           IPCArgNone },
+	{ "setlayout",      setlayout,      IPCArgLayout },
+	{ "setmfact",       setmfact,       IPCArgFloat },
+	{ "incnmaster",     incnmaster,     IPCArgInt },
+	{ "togglefloating", togglefloating, IPCArgNone },
+	{ "togglebar",      togglebar,      IPCArgNone },
+	{ "incrgaps",       incrgaps,       IPCArgInt },
+	{ "togglegaps",     togglegaps,     IPCArgNone },
+	{ "defaultgaps",    defaultgaps,    IPCArgNone },
+	{ "killclient",     killclient,     IPCArgNone },
+	{ "spawn",          spawn,          IPCArgShell },
+	{ "xrdb",           xrdb,           IPCArgNone },
+	{ "record",         record,         IPCArgNone },
+	{ "quit",           quit,           IPCArgInt },
+};
@@ -14,6 +14,21 @@ X11LIB = /usr/X11R6/lib
 XINERAMALIBS  = -lXinerama
 XINERAMAFLAGS = -DXINERAMA
 
+# Xrandr, used for the refresh rate, screen change events and the monitor
+# list; comment if you don't want it
+XRANDRLIBS  = -lXrandr
+XRANDRFLAGS = -DXRANDR
+
+# XSync, lets clients pace resizes with _NET_WM_SYNC_REQUEST; comment if you
+# don't want it
+XSYNCLIBS  = -lXext
+XSYNCFLAGS = -DXSYNC
+
+# timeline of manage/arrange/layout/drawbar/restack/focus and X round-trips,
+# written as Chrome trace JSON on SIGUSR1 (see timeline.c); uncomment if you
+# want it
+#TIMELINEFLAGS = -DTIMELINE
+
 # freetype
 FREETYPELIBS = -lfontconfig -lXft
 FREETYPEINC = /usr/include/freetype2
@@ -24,10 +39,10 @@ FREETYPEINC = /usr/include/freetype2
 
 # includes and libs
 INCS = -I${X11INC} -I${FREETYPEINC}
-LIBS = -L${X11LIB} -lX11 ${XINERAMALIBS} ${FREETYPELIBS} -lX11-xcb -lxcb -lxcb-res ${KVMLIB}
+LIBS = -L${X11LIB} -lX11 ${XINERAMALIBS} ${XRANDRLIBS} ${XSYNCLIBS} ${FREETYPELIBS} -lX11-xcb -lxcb -lxcb-res -lpthread ${KVMLIB}
 
 # flags
-CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_XOPEN_SOURCE=700L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS}
+CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_XOPEN_SOURCE=700L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS} ${XRANDRFLAGS} ${XSYNCFLAGS} ${TIMELINEFLAGS}
 #CFLAGS   = -g -std=c99 -pedantic -Wall -O0 ${INCS} ${CPPFLAGS}
 CFLAGS   = -std=c99 -pedantic -Wall -Wno-deprecated-declarations -Wno-unused-function -Os ${INCS} ${CPPFLAGS}
 LDFLAGS  = ${LIBS}
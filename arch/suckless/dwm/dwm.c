@@ -20,16 +20,27 @@
  *
  * To understand everything else, start reading main().
  */
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <locale.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <X11/cursorfont.h>
 #include <X11/keysym.h>
 #include <X11/Xatom.h>
@@ -40,6 +51,12 @@
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif /* XINERAMA */
+#ifdef XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif /* XRANDR */
+#ifdef XSYNC
+#include <X11/extensions/sync.h>
+#endif /* XSYNC */
 #include <X11/Xft/Xft.h>
 #include <X11/Xlib-xcb.h>
 #include <xcb/res.h>
@@ -54,15 +71,34 @@
 /* macros */
 #define BUTTONMASK              (ButtonPressMask|ButtonReleaseMask)
 #define CLEANMASK(mask)         (mask & ~(numlockmask|LockMask) & (ShiftMask|ControlMask|Mod1Mask|Mod2Mask|Mod3Mask|Mod4Mask|Mod5Mask))
+#define CLIENTMASK              (EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask)
 #define INTERSECT(x,y,w,h,m)    (MAX(0, MIN((x)+(w),(m)->wx+(m)->ww) - MAX((x),(m)->wx)) \
                                * MAX(0, MIN((y)+(h),(m)->wy+(m)->wh) - MAX((y),(m)->wy)))
 #define ISVISIBLE(C)            ((C->tags & C->mon->tagset[C->mon->seltags]))
+#define SWALLOWED(C)            ((Client *)poolget((C)->swallowing))
 #define LENGTH(X)               (sizeof X / sizeof X[0])
 #define MOUSEMASK               (BUTTONMASK|PointerMotionMask)
+#define ROOTMASK                (SubstructureRedirectMask|SubstructureNotifyMask \
+                                | ButtonPressMask|PointerMotionMask|EnterWindowMask \
+                                | LeaveWindowMask|StructureNotifyMask|PropertyChangeMask)
 #define WIDTH(X)                ((X)->w + 2 * (X)->bw)
 #define HEIGHT(X)               ((X)->h + 2 * (X)->bw)
 #define TAGMASK                 ((1 << LENGTH(tags)) - 1)
+#define POOLTAG                 (1 << LENGTH(tags)) /* spare terminals, never viewed */
+#define SCRATCHTAG              (POOLTAG << 1)      /* the scratchpad while hidden */
 #define TEXTW(X)                (drw_fontset_getwidth(drw, (X)) + lrpad)
+#ifdef TIMELINE
+#define SPANBEGIN(N)            timelineadd((N), 'B', 0)
+#define SPANEND(N)              timelineadd((N), 'E', 0)
+#define ASYNCBEGIN(N,ID)        timelineadd((N), 'b', (ID))
+#define ASYNCEND(N,ID)          timelineadd((N), 'e', (ID))
+#else
+#define SPANBEGIN(N)
+#define SPANEND(N)
+#define ASYNCBEGIN(N,ID)
+#define ASYNCEND(N,ID)
+#endif /* TIMELINE */
+#define KEYMODIDX(M)            (((M) & ShiftMask) | (((M) >> 1) & 0x7e)) /* CLEANMASK'ed mask to 0..127 */
 
 /* xrdb: validate and load a color string from X resources */
 #define XRDB_LOAD_COLOR(R,V)    if (XrmGetResource(xrdb, R, NULL, &type, &value) == True) { \
@@ -86,7 +122,11 @@ enum { CurNormal, CurResize, CurMove, CurLast }; /* cursor */
 enum { SchemeNorm, SchemeSel, SchemeStatus, SchemeTagsSel, SchemeTagsNorm, SchemeInfoSel, SchemeInfoNorm }; /* color schemes */
 enum { NetSupported, NetWMName, NetWMState, NetWMCheck,
        NetWMFullscreen, NetActiveWindow, NetWMWindowType,
-       NetWMWindowTypeDialog, NetClientList, NetLast }; /* EWMH atoms */
+       NetWMWindowTypeDialog, NetClientList, NetWMBypassCompositor,
+#ifdef XSYNC
+       NetWMSyncRequest, NetWMSyncRequestCounter,
+#endif /* XSYNC */
+       NetLast }; /* EWMH atoms */
 enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMLast }; /* default atoms */
 enum { ClkTagBar, ClkLtSymbol, ClkStatusText, ClkWinTitle,
        ClkClientWin, ClkRootWin, ClkLast }; /* clicks */
@@ -108,22 +148,59 @@ typedef struct {
 
 typedef struct Monitor Monitor;
 typedef struct Client Client;
-struct Client {
+typedef struct RuleMatch RuleMatch;
+
+/* client state only read on property changes, fullscreen toggles, hinted
+ * resizes and sync requests, allocated apart from its Client */
+typedef struct {
 	char name[256];
-	float mina, maxa;
-	float cfact;
-	int x, y, w, h;
 	int oldx, oldy, oldw, oldh;
+	int oldbw, oldstate;
 	int basew, baseh, incw, inch, maxw, maxh, minw, minh, hintsvalid;
-	int bw, oldbw;
-	unsigned int tags;
-	int isfixed, isfloating, isurgent, neverfocus, oldstate, isfullscreen, isterminal, noswallow;
-	pid_t pid;
+	float mina, maxa;
+	int isfixed;
+	RuleMatch *rm;        /* rules matching the class and instance */
+#ifdef XSYNC
+	XSyncCounter synccounter; /* _NET_WM_SYNC_REQUEST_COUNTER, None if unsupported */
+	XSyncAlarm syncalarm;     /* fires once the counter reaches syncvalue */
+	XSyncValue syncvalue;     /* last value requested */
+	int syncwait, syncdirty;  /* request outstanding, geometry held back meanwhile */
+	long long syncat;         /* when to stop waiting for the client */
+#endif /* XSYNC */
+} ClientCold;
+
+/* Hot fields read by every layout and visibility walk (nexttiled, ISVISIBLE,
+ * showhide, drawbar) come first so that a walk reads them together; names,
+ * size hints, old geometry, rule and sync state live in the ClientCold. */
+struct Client {
 	Client *next;
 	Client *snext;
-	Client *swallowing;
 	Monitor *mon;
 	Window win;
+	unsigned int tags;
+	int isfloating, isfullscreen;
+	int x, y, w, h;
+	int bw;
+	int ishidden;         /* window parked off screen by showhide */
+	int isiconic;         /* window unmapped in IconicState, see hiddenunmap */
+	int isurgent, neverfocus;
+	int grabstate;        /* 0 no button grabs yet, 1 unfocused, 2 focused */
+	float cfact;
+	ClientCold *cold;
+	Client *prev;
+	Client *sprev;
+	int ispending, pendx, pendy, pendw, pendh; /* deferred layout geometry */
+	int isterminal, noswallow;
+	pid_t pid;
+	Ref swallowing;       /* client whose window this one took over */
+	int isscratch;        /* the terminal togglescratch shows and hides */
+	unsigned int protos;  /* WM_PROTOCOLS, as 1 << WMDelete | 1 << WMTakeFocus */
+	XWMHints wmh;         /* WM_HINTS as last read, valid if haswmh */
+	int haswmh;
+	Atom wtype;           /* _NET_WM_WINDOW_TYPE */
+	int ownbypass;        /* _NET_WM_BYPASS_COMPOSITOR was set by dwm, not the client */
+	int fgeom[2][4];      /* floating x, y, w, h per orientation: landscape, portrait */
+	unsigned char fgeomset, forient; /* saved fgeom orientations, orientation last seen */
 };
 
 typedef struct {
@@ -153,16 +230,60 @@ struct Monitor {
 	unsigned int seltags;
 	unsigned int sellt;
 	unsigned int tagset[2];
+	unsigned int occ, urg;           /* tags with occupants / urgent clients */
+	unsigned int ntagocc[32], ntagurg[32];
 	int showbar;
 	int topbar;
+	int titlex;           /* where the title starts, set by drawbar */
 	Client *clients;
+	Client *last;         /* tail of clients */
 	Client *sel;
 	Client *stack;
 	Monitor *next;
 	Window barwin;
 	const Layout *lt[2];
+	Window *stackwins;    /* tiled stacking order last imposed by restack */
+	unsigned int nstackwins, stackwinscap;
+};
+
+/* blocking work handed to the worker thread; run() is called there and
+ * done() back on the main thread, which then frees the job */
+typedef struct Job Job;
+struct Job {
+	void (*run)(Job *j);
+	void (*done)(Job *j);
+	Job *next;
 };
 
+typedef struct {
+	Job job;
+	Ref client;           /* new client */
+	Window win;           /* and its window, for the worker */
+	long long at;         /* when it was managed */
+	pid_t pid;            /* result: its pid */
+	int term;             /* result: terms index it was started from, or -1 */
+	unsigned int nterms;
+	struct { Ref client; pid_t pid; } terms[]; /* swallow candidates */
+} SwallowJob;
+
+typedef struct {
+	Job job;
+	pid_t pid;            /* cached status bar pid in, found one out */
+	int sig, button;
+} StatusJob;
+
+typedef struct {
+	unsigned long n;
+	long long last, total, max;
+} Timing;
+
+typedef struct {
+	char *text;
+	size_t size;          /* allocated bytes of text */
+	int sig;              /* statuscmd signal byte opening the block, 0 if none */
+	int w;                /* text width */
+} StatusBlock;
+
 typedef struct {
 	const char *class;
 	const char *instance;
@@ -174,15 +295,27 @@ typedef struct {
 	int monitor;
 } Rule;
 
+enum { IPCArgNone, IPCArgInt, IPCArgUint, IPCArgFloat, IPCArgLayout, IPCArgShell }; /* ipc argument types */
+
+typedef struct {
+	const char *name;
+	void (*func)(const Arg *);
+	int argtype;
+} IPCCommand;
+
 /* function declarations */
-static void applyrules(Client *c);
+static void applypending(Client *c);
+static int applyrules(Client *c);
+static void applyscreen(void);
 static int applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact);
 static void arrange(Monitor *m);
 static void arrangemon(Monitor *m);
 static void attach(Client *c);
+static void attachbefore(Client *c, Client *next);
 static void attachstack(Client *c);
 static void buttonpress(XEvent *e);
 static void checkotherwm(void);
+static Client *claimspare(void);
 static void cleanup(void);
 static void cleanupmon(Monitor *mon);
 static void clientmessage(XEvent *e);
@@ -196,44 +329,65 @@ static void detachstack(Client *c);
 static Monitor *dirtomon(int dir);
 static void drawbar(Monitor *m);
 static void drawbars(void);
+static void drawstatusblock(unsigned int i);
 static void enternotify(XEvent *e);
 static void expose(XEvent *e);
+static void fillspares(void);
 static void focus(Client *c);
 static void focusin(XEvent *e);
 static void focusmon(const Arg *arg);
 static void focusstack(const Arg *arg);
+static void focustop(Client *c);
+static void freeclient(Client *c);
 static Atom getatomprop(Client *c, Atom prop);
 static int getrootptr(int *x, int *y);
 static long getstate(Window w);
-static pid_t getstatusbarpid(void);
+static pid_t getstatusbarpid(pid_t cached);
 static int gettextprop(Window w, Atom atom, char *text, unsigned int size);
 static void grabbuttons(Client *c, int focused);
 static void grabkeys(void);
 static void incnmaster(const Arg *arg);
+static int iscovered(Monitor *m);
+static int isstatusbar(const char *pid);
+static int keycmp(const void *a, const void *b);
 static void keypress(XEvent *e);
 static void killclient(const Arg *arg);
+static void launched(pid_t pid, long long at);
 static void loadxrdb(void);
 static void manage(Window w, XWindowAttributes *wa);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
 static void monocle(Monitor *m);
 static void motionnotify(XEvent *e);
+static Bool motionpending(Display *dpy, XEvent *ev, XPointer arg);
 static void movemouse(const Arg *arg);
+static void moveresize(Client *c, int resized);
 static Client *nexttiled(Client *c);
+static long long nowms(void);
+static long long nowus(void);
 static void pop(Client *c);
 static Client *prevtiled(Client *c);
 static void propertynotify(XEvent *e);
+static void pullclient(Client *c);
 static void pushdown(const Arg *arg);
 static void pushup(const Arg *arg);
+static void queuejob(Job *j);
+static void queueswallow(Client *c, int findterm);
 static void quit(const Arg *arg);
+static void reapplyrules(Client *c);
+static void record(const Arg *arg);
 static Monitor *recttomon(int x, int y, int w, int h);
+static void redrawstatus(unsigned int nchanged, unsigned int last);
 static void resize(Client *c, int x, int y, int w, int h, int interact);
 static void resizeclient(Client *c, int x, int y, int w, int h);
 static void resizemouse(const Arg *arg);
 static void restack(Monitor *m);
+static RuleMatch *rulematch(const char *class, const char *instance);
+static void rulematchfree(RuleMatch *rm);
 static void run(void);
 static void scan(void);
-static int sendevent(Client *c, Atom proto);
+static void screenchanged(void);
+static int sendevent(Client *c, int proto);
 static void sendmon(Client *c, Monitor *m);
 static void setclientstate(Client *c, long state);
 static void setfocus(Client *c);
@@ -241,17 +395,30 @@ static void setfullscreen(Client *c, int fullscreen);
 static void setlayout(const Arg *arg);
 static void setcfact(const Arg *arg);
 static void setmfact(const Arg *arg);
+static void setpending(Client *c, int x, int y, int w, int h);
+static int setstatusblock(unsigned int i, int sig, const char *text, size_t len);
+static void setstatuspid(pid_t pid);
+static void settags(Client *c, unsigned int newtags);
 static void setup(void);
 static void seturgent(Client *c, int urg);
+static void seturgentflag(Client *c, int urg);
 static void showhide(Client *c);
+static void showpending(Monitor *m);
 static void sigstatusbar(const Arg *arg);
 static void spawn(const Arg *arg);
 static void tag(const Arg *arg);
 static void sighup(int unused);
 static void sigterm(int unused);
+static void spawnterm(const Arg *arg);
+static void stackkeep(const int *pos, int *keep, unsigned int n);
+static void statusbarfound(Job *job);
+static void statusbarlookup(Job *job);
+static void tagcount(Client *c, int d);
 static void tagmon(const Arg *arg);
+static void timing(Timing *t, long long v);
 static void togglebar(const Arg *arg);
 static void togglefloating(const Arg *arg);
+static void togglescratch(const Arg *arg);
 static void toggletag(const Arg *arg);
 static void toggleview(const Arg *arg);
 static void unfocus(Client *c, int setfocus);
@@ -262,6 +429,8 @@ static void updatebars(void);
 static void updateclientlist(void);
 static int updategeom(void);
 static void updatenumlockmask(void);
+static void updateprotocols(Client *c);
+static void updaterefreshrate(void);
 static void updatesizehints(Client *c);
 static void updatestatus(void);
 static void updatetitle(Client *c);
@@ -270,6 +439,9 @@ static void updatewmhints(Client *c);
 static void view(const Arg *arg);
 static Client *wintoclient(Window w);
 static Monitor *wintomon(Window w);
+static void *worker(void *unused);
+static void workerdone(void);
+static void writeclientlist(void);
 static int xerror(Display *dpy, XErrorEvent *ee);
 static int xerrordummy(Display *dpy, XErrorEvent *ee);
 static int xerrorstart(Display *dpy, XErrorEvent *ee);
@@ -279,21 +451,64 @@ static void zoom(const Arg *arg);
 static pid_t getparentprocess(pid_t p);
 static int isdescprocess(pid_t p, pid_t c);
 static Client *swallowingclient(Window w);
-static Client *termforwin(const Client *c);
+static void swallowlookup(Job *job);
+static void swallowresult(Job *job);
 static pid_t winpid(Window w);
 
+#ifdef XSYNC
+static long long synccheck(void);
+static void syncdone(Client *c);
+static void syncdrain(void);
+static void syncnotify(XEvent *e);
+static void syncrequest(Client *c);
+static void updatesync(Client *c, int enable);
+#endif /* XSYNC */
+
 /* variables */
 static const char broken[] = "broken";
 static char stext[256];
+static StatusBlock *statusblocks; /* status split at statuscmd signal bytes */
+static unsigned int nstatusblocks, statusblockscap;
 static int statusw;
 static int statussig;
 static pid_t statuspid = -1;
+static int statusregistered;  /* statuspid came from the bar itself over ipc */
+static int statuspidfd = -1;  /* pidfd of the registered status bar */
+static pthread_t workerthread;
+static pthread_mutex_t jobslock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobscond = PTHREAD_COND_INITIALIZER;
+static Job *jobs, *lastjob;   /* queued for the worker */
+static int workerpipe[2] = { -1, -1 }; /* finished jobs back to the main loop */
+static int workerstop;
+static int clientlistdirty;
+extern char **environ;
+static posix_spawnattr_t spawnattr;
+static posix_spawn_file_actions_t spawnactions;
+static Timing spawntime;     /* us spent in posix_spawn */
+static Timing launchtime;    /* ms from spawn() to the window being managed */
+static struct { pid_t pid; long long at; } launches[8]; /* recent spawns */
+static unsigned int nlaunches;
+static int sparespending;     /* spare terminals spawned but not managed yet */
+static long long sparesat;    /* when the last one was spawned */
+static int scratchwanted;     /* show the next spare as the scratchpad */
+static Atom claimedatom;      /* on spares taken out of the pool, for restarts */
 static int screen;
 static int sw, sh;           /* X display screen geometry width, height */
 static int bh;               /* bar height */
 static int lrpad;            /* sum of left and right padding for text */
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned int numlockmask = 0;
+static unsigned int motioninterval; /* ms between handled pointer motions */
+#ifdef XRANDR
+static int rrevbase = -1;    /* RandR event base, -1 without the extension */
+static int rrmonitors;       /* RandR 1.5 monitor list available */
+#endif /* XRANDR */
+#ifdef XSYNC
+static int syncevbase = -1;  /* XSync event base, -1 without the extension */
+static int nsyncwait;        /* clients with an outstanding sync request */
+#endif /* XSYNC */
+static long long screenat;   /* when to apply the pending screen change, 0 if none */
+static int deferlayout;      /* arrangemon of a covered monitor, resize only records */
 static void (*handler[LASTEvent]) (XEvent *) = {
 	[ButtonPress] = buttonpress,
 	[ClientMessage] = clientmessage,
@@ -318,6 +533,8 @@ static Clr **scheme;
 static Display *dpy;
 static Drw *drw;
 static Monitor *mons, *selmon;
+static Pool clientpool = { .size = sizeof(Client) }, coldpool = { .size = sizeof(ClientCold) };
+static Pool monpool = { .size = sizeof(Monitor) };
 static Window root, wmcheckwin;
 
 static xcb_connection_t *xcon;
@@ -325,36 +542,77 @@ static xcb_connection_t *xcon;
 /* configuration, allows nested code to access above variables */
 #include "config.h"
 
-/* compile-time check if all tags fit into an unsigned int bit array. */
-struct NumTags { char limitexceeded[LENGTH(tags) > 31 ? -1 : 1]; };
+/* compile-time check if all tags, POOLTAG and SCRATCHTAG fit into an unsigned int bit array. */
+struct NumTags { char limitexceeded[LENGTH(tags) > 29 ? -1 : 1]; };
+
+/* rules whose class and instance match a given WM_CLASS, cached per class so
+ * that only title rules are evaluated for every new window */
+struct RuleMatch {
+	char *class, *instance;
+	unsigned int n;
+	unsigned short rule[LENGTH(rules)];
+	int iscached;         /* else owned by the one client it was made for */
+	RuleMatch *next;
+};
+static RuleMatch *rulematches[64];
+
+/* compile-time check if all key indices fit into the keycode dispatch table */
+struct NumKeys { char limitexceeded[LENGTH(keys) > 254 ? -1 : 1]; };
+
+/* keys[] index + 1 of the first binding per keycode and modifier state, and
+ * of the next binding with the same keysym and modifiers; built by grabkeys */
+static unsigned char keytable[256][128];
+static unsigned char keydup[LENGTH(keys)];
+
+#include "ipc.c"
+#include "record.c"
+#ifdef TIMELINE
+#include "timeline.c"
+#endif /* TIMELINE */
 
 /* function implementations */
 void
+applypending(Client *c)
+{
+	if (!c->ispending)
+		return;
+	c->ispending = 0;
+	resize(c, c->pendx, c->pendy, c->pendw, c->pendh, 0);
+}
+
+/* returns the number of matching rules; c->tags stays 0 if none sets tags */
+int
 applyrules(Client *c)
 {
 	const char *class, *instance;
 	unsigned int i;
 	const Rule *r;
+	RuleMatch *rm;
 	Monitor *m;
 	XClassHint ch = { NULL, NULL };
+	int n = 0;
 
 	/* rule matching */
 	c->isfloating = 0;
 	c->tags = 0;
+	SPANBEGIN("XGetClassHint");
 	XGetClassHint(dpy, c->win, &ch);
+	SPANEND("XGetClassHint");
 	class    = ch.res_class ? ch.res_class : broken;
 	instance = ch.res_name  ? ch.res_name  : broken;
+	c->cold->rm = rm = rulematch(class, instance);
 
-	for (i = 0; i < LENGTH(rules); i++) {
-		r = &rules[i];
-		if ((!r->title || strstr(c->name, r->title))
-		&& (!r->class || strstr(class, r->class))
-		&& (!r->instance || strstr(instance, r->instance)))
+	for (i = 0; i < rm->n; i++) {
+		r = &rules[rm->rule[i]];
+		if (!r->title || strstr(c->cold->name, r->title))
 		{
+			n++;
 			c->isterminal = r->isterminal;
 			c->noswallow  = r->noswallow;
 			c->isfloating = r->isfloating;
 			c->tags |= r->tags;
+			if (r->monitor < 0)
+				continue;
 			for (m = mons; m && m->num != r->monitor; m = m->next);
 			if (m)
 				c->mon = m;
@@ -364,7 +622,55 @@ applyrules(Client *c)
 		XFree(ch.res_class);
 	if (ch.res_name)
 		XFree(ch.res_name);
-	c->tags = c->tags & TAGMASK ? c->tags & TAGMASK : c->mon->tagset[c->mon->seltags];
+	c->tags &= TAGMASK | POOLTAG;
+	if (c->tags & POOLTAG && getatomprop(c, claimedatom) == claimedatom)
+		c->tags &= ~POOLTAG; /* claimed before a restart */
+	return n;
+}
+
+/* re-layout once rotation or hotplug events have settled; floating clients
+ * get back the geometry they last had in the orientation now entered */
+void
+applyscreen(void)
+{
+	Monitor *m;
+	Client *c;
+	int o, dirty;
+
+	screenat = 0;
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next) {
+			o = c->forient = m->mw <= m->mh;
+			if (c->isfloating && !c->isfullscreen) {
+				c->fgeom[o][0] = c->x;
+				c->fgeom[o][1] = c->y;
+				c->fgeom[o][2] = c->w;
+				c->fgeom[o][3] = c->h;
+				c->fgeomset |= 1 << o;
+			}
+		}
+	dirty = drw->w != (unsigned int)sw; /* the bar drawable still has the old width */
+	if (!updategeom() && !dirty)
+		return;
+	updaterefreshrate();
+	drw_resize(drw, sw, bh);
+	updatebars();
+	for (m = mons; m; m = m->next) {
+		for (c = m->clients; c; c = c->next) {
+			o = m->mw <= m->mh;
+			if (c->isfullscreen)
+				resizeclient(c, m->mx, m->my, m->mw, m->mh);
+			else if (c->isfloating && o != c->forient && c->fgeomset & 1 << o) {
+				c->x = c->fgeom[o][0];
+				c->y = c->fgeom[o][1];
+				c->w = c->fgeom[o][2];
+				c->h = c->fgeom[o][3];
+			}
+		}
+		XMoveResizeWindow(dpy, m->barwin, m->wx, m->by, m->ww, bh);
+	}
+	focus(NULL);
+	arrange(NULL);
 }
 
 int
@@ -400,37 +706,37 @@ applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact)
 	if (*w < bh)
 		*w = bh;
 	if (resizehints || c->isfloating || !c->mon->lt[c->mon->sellt]->arrange) {
-		if (!c->hintsvalid)
+		if (!c->cold->hintsvalid)
 			updatesizehints(c);
 		/* see last two sentences in ICCCM 4.1.2.3 */
-		baseismin = c->basew == c->minw && c->baseh == c->minh;
+		baseismin = c->cold->basew == c->cold->minw && c->cold->baseh == c->cold->minh;
 		if (!baseismin) { /* temporarily remove base dimensions */
-			*w -= c->basew;
-			*h -= c->baseh;
+			*w -= c->cold->basew;
+			*h -= c->cold->baseh;
 		}
 		/* adjust for aspect limits */
-		if (c->mina > 0 && c->maxa > 0) {
-			if (c->maxa < (float)*w / *h)
-				*w = *h * c->maxa + 0.5;
-			else if (c->mina < (float)*h / *w)
-				*h = *w * c->mina + 0.5;
+		if (c->cold->mina > 0 && c->cold->maxa > 0) {
+			if (c->cold->maxa < (float)*w / *h)
+				*w = *h * c->cold->maxa + 0.5;
+			else if (c->cold->mina < (float)*h / *w)
+				*h = *w * c->cold->mina + 0.5;
 		}
 		if (baseismin) { /* increment calculation requires this */
-			*w -= c->basew;
-			*h -= c->baseh;
+			*w -= c->cold->basew;
+			*h -= c->cold->baseh;
 		}
 		/* adjust for increment value */
-		if (c->incw)
-			*w -= *w % c->incw;
-		if (c->inch)
-			*h -= *h % c->inch;
+		if (c->cold->incw)
+			*w -= *w % c->cold->incw;
+		if (c->cold->inch)
+			*h -= *h % c->cold->inch;
 		/* restore base dimensions */
-		*w = MAX(*w + c->basew, c->minw);
-		*h = MAX(*h + c->baseh, c->minh);
-		if (c->maxw)
-			*w = MIN(*w, c->maxw);
-		if (c->maxh)
-			*h = MIN(*h, c->maxh);
+		*w = MAX(*w + c->cold->basew, c->cold->minw);
+		*h = MAX(*h + c->cold->baseh, c->cold->minh);
+		if (c->cold->maxw)
+			*w = MIN(*w, c->cold->maxw);
+		if (c->cold->maxh)
+			*h = MIN(*h, c->cold->maxh);
 	}
 	return *x != c->x || *y != c->y || *w != c->w || *h != c->h;
 }
@@ -438,6 +744,7 @@ applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact)
 void
 arrange(Monitor *m)
 {
+	SPANBEGIN("arrange");
 	if (m)
 		showhide(m->stack);
 	else for (m = mons; m; m = m->next)
@@ -447,27 +754,59 @@ arrange(Monitor *m)
 		restack(m);
 	} else for (m = mons; m; m = m->next)
 		arrangemon(m);
+	SPANEND("arrange");
 }
 
 void
 arrangemon(Monitor *m)
 {
+	Client *c;
+
+	for (c = m->clients; c; c = c->next)
+		c->ispending = 0;
 	strncpy(m->ltsymbol, m->lt[m->sellt]->symbol, sizeof m->ltsymbol);
-	if (m->lt[m->sellt]->arrange)
+	if (m->lt[m->sellt]->arrange) {
+		/* the tiled clients are hidden under the fullscreen one, the
+		 * layout still runs for its symbol but only records their
+		 * geometry, the arrange() after fullscreen ends applies it */
+		deferlayout = iscovered(m);
+		SPANBEGIN(m->lt[m->sellt]->symbol);
 		m->lt[m->sellt]->arrange(m);
+		SPANEND(m->lt[m->sellt]->symbol);
+		deferlayout = 0;
+	}
 }
 
 void
 attach(Client *c)
 {
-	c->next = c->mon->clients;
-	c->mon->clients = c;
+	attachbefore(c, c->mon->clients);
+}
+
+/* inserts c in front of next, or appends it if next is NULL */
+void
+attachbefore(Client *c, Client *next)
+{
+	c->next = next;
+	c->prev = next ? next->prev : c->mon->last;
+	if (c->prev)
+		c->prev->next = c;
+	else
+		c->mon->clients = c;
+	if (next)
+		next->prev = c;
+	else
+		c->mon->last = c;
+	tagcount(c, +1);
 }
 
 void
 attachstack(Client *c)
 {
+	c->sprev = NULL;
 	c->snext = c->mon->stack;
+	if (c->snext)
+		c->snext->sprev = c;
 	c->mon->stack = c;
 }
 
@@ -486,14 +825,26 @@ swallow(Client *p, Client *c)
 	setclientstate(c, WithdrawnState);
 	XUnmapWindow(dpy, p->win);
 
-	p->swallowing = c;
+	p->swallowing = poolref(c);
 	c->mon = p->mon;
+#ifdef XSYNC
+	updatesync(c, 0); /* p takes over the window, and its counter */
+#endif /* XSYNC */
 
 	Window w = p->win;
 	p->win = c->win;
 	c->win = w;
+	int g = p->grabstate; /* button grabs stay with their window */
+	p->grabstate = c->grabstate;
+	c->grabstate = g;
+	g = p->isiconic; /* so does the mapping state */
+	p->isiconic = c->isiconic;
+	c->isiconic = g;
+	updateprotocols(p); /* the cached window properties follow the window */
+	updatewmhints(p);
 	updatetitle(p);
 	XMoveResizeWindow(dpy, p->win, p->x, p->y, p->w, p->h);
+	p->ishidden = 0;
 	arrange(p->mon);
 	configure(p);
 	updateclientlist();
@@ -502,10 +853,15 @@ swallow(Client *p, Client *c)
 void
 unswallow(Client *c)
 {
-	c->win = c->swallowing->win;
+	Client *s = SWALLOWED(c);
+
+	c->win = s->win;
+	c->grabstate = s->grabstate;
+	updateprotocols(c);
+	updatewmhints(c);
 
-	free(c->swallowing);
-	c->swallowing = NULL;
+	freeclient(s);
+	c->swallowing = poolref(NULL);
 
 	/* unfullscreen the client */
 	setfullscreen(c, 0);
@@ -513,6 +869,8 @@ unswallow(Client *c)
 	arrange(c->mon);
 	XMapWindow(dpy, c->win);
 	XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+	c->ishidden = 0;
+	c->isiconic = 0;
 	setclientstate(c, NormalState);
 	focus(NULL);
 	arrange(c->mon);
@@ -526,7 +884,6 @@ buttonpress(XEvent *e)
 	Client *c;
 	Monitor *m;
 	XButtonPressedEvent *ev = &e->xbutton;
-	char *text, *s, ch;
 
 	click = ClkRootWin;
 	/* focus monitor if necessary */
@@ -537,12 +894,9 @@ buttonpress(XEvent *e)
 	}
 	if (ev->window == selmon->barwin) {
 		i = x = 0;
-		unsigned int occ = 0;
-		for(c = m->clients; c; c=c->next)
-			occ |= c->tags == TAGMASK ? 0 : c->tags;
 		do {
 			/* Do not reserve space for vacant tags */
-			if (!(occ & 1 << i || m->tagset[m->seltags] & 1 << i))
+			if (!(m->occ & 1 << i || m->tagset[m->seltags] & 1 << i))
 				continue;
 			x += TEXTW(tags[i]);
 		} while (ev->x >= x && ++i < LENGTH(tags));
@@ -555,21 +909,13 @@ buttonpress(XEvent *e)
 			x = selmon->ww - statusw;
 			click = ClkStatusText;
 			statussig = 0;
-			for (text = s = stext; *s && x <= ev->x; s++) {
-				if ((unsigned char)(*s) < ' ') {
-					ch = *s;
-					*s = '\0';
-					x += TEXTW(text) - lrpad;
-					*s = ch;
-					text = s + 1;
-					if (x >= ev->x)
-						break;
-					/* End clickable section on a matching signal raw byte */
-					if (statussig == ch)
-						statussig = 0;
-					else
-						statussig = ch;
-				}
+			for (i = 0; i < nstatusblocks; i++) {
+				/* End clickable section on a matching signal raw byte */
+				if (statusblocks[i].sig)
+					statussig = statussig == statusblocks[i].sig ? 0 : statusblocks[i].sig;
+				x += statusblocks[i].w;
+				if (x >= ev->x)
+					break;
 			}
 		} else
 			click = ClkWinTitle;
@@ -596,12 +942,34 @@ checkotherwm(void)
 	XSync(dpy, False);
 }
 
+/* takes a running terminal from the hidden pool onto the selected monitor,
+ * so getting one only costs a retag; a replacement is started behind it */
+Client *
+claimspare(void)
+{
+	Client *c = NULL;
+	Monitor *m;
+
+	for (m = mons; m && !c; m = m->next)
+		for (c = m->clients; c && c->tags != POOLTAG; c = c->next);
+	if (!c)
+		return NULL;
+	/* it keeps the pool instance name, a restarted dwm must not hide it */
+	XChangeProperty(dpy, c->win, claimedatom, XA_ATOM, 32,
+		PropModeReplace, (unsigned char *)&claimedatom, 1);
+	pullclient(c);
+	fillspares();
+	return c;
+}
+
 void
 cleanup(void)
 {
 	Arg a = {.ui = ~0};
 	Layout foo = { "", NULL };
 	Monitor *m;
+	Job *j;
+	RuleMatch *rm;
 	size_t i;
 
 	view(&a);
@@ -609,16 +977,47 @@ cleanup(void)
 	for (m = mons; m; m = m->next)
 		while (m->stack)
 			unmanage(m->stack, 0);
+	writeclientlist();
 	XUngrabKey(dpy, AnyKey, AnyModifier, root);
+	setstatuspid(-1);
+	pthread_mutex_lock(&jobslock);
+	workerstop = 1;
+	pthread_cond_signal(&jobscond);
+	pthread_mutex_unlock(&jobslock);
+	pthread_join(workerthread, NULL);
+	workerdone();
+	while ((j = jobs)) { /* never started */
+		jobs = j->next;
+		free(j);
+	}
+	close(workerpipe[0]);
+	close(workerpipe[1]);
 	while (mons)
 		cleanupmon(mons);
+	pooldestroy(&clientpool);
+	pooldestroy(&coldpool);
+	pooldestroy(&monpool);
+	for (i = 0; i < LENGTH(rulematches); i++)
+		while ((rm = rulematches[i])) {
+			rulematches[i] = rm->next;
+			rm->iscached = 0;
+			rulematchfree(rm);
+		}
 	for (i = 0; i < CurLast; i++)
 		drw_cur_free(drw, cursor[i]);
 	for (i = 0; i < LENGTH(colors); i++)
 		free(scheme[i]);
 	free(scheme);
+	for (i = 0; i < statusblockscap; i++)
+		free(statusblocks[i].text);
+	free(statusblocks);
 	XDestroyWindow(dpy, wmcheckwin);
 	drw_free(drw);
+	ipccleanup();
+	if (recordfp)
+		record(NULL);
+	posix_spawnattr_destroy(&spawnattr);
+	posix_spawn_file_actions_destroy(&spawnactions);
 	XSync(dpy, False);
 	XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
 	XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
@@ -637,7 +1036,8 @@ cleanupmon(Monitor *mon)
 	}
 	XUnmapWindow(dpy, mon->barwin);
 	XDestroyWindow(dpy, mon->barwin);
-	free(mon);
+	free(mon->stackwins);
+	poolfree(&monpool, mon);
 }
 
 void
@@ -681,28 +1081,12 @@ configure(Client *c)
 void
 configurenotify(XEvent *e)
 {
-	Monitor *m;
-	Client *c;
 	XConfigureEvent *ev = &e->xconfigure;
-	int dirty;
 
-	/* TODO: updategeom handling sucks, needs to be simplified */
 	if (ev->window == root) {
-		dirty = (sw != ev->width || sh != ev->height);
 		sw = ev->width;
 		sh = ev->height;
-		if (updategeom() || dirty) {
-			drw_resize(drw, sw, bh);
-			updatebars();
-			for (m = mons; m; m = m->next) {
-				for (c = m->clients; c; c = c->next)
-					if (c->isfullscreen)
-						resizeclient(c, m->mx, m->my, m->mw, m->mh);
-				XMoveResizeWindow(dpy, m->barwin, m->wx, m->by, m->ww, bh);
-			}
-			focus(NULL);
-			arrange(NULL);
-		}
+		screenchanged();
 	}
 }
 
@@ -720,19 +1104,19 @@ configurerequest(XEvent *e)
 		else if (c->isfloating || !selmon->lt[selmon->sellt]->arrange) {
 			m = c->mon;
 			if (ev->value_mask & CWX) {
-				c->oldx = c->x;
+				c->cold->oldx = c->x;
 				c->x = m->mx + ev->x;
 			}
 			if (ev->value_mask & CWY) {
-				c->oldy = c->y;
+				c->cold->oldy = c->y;
 				c->y = m->my + ev->y;
 			}
 			if (ev->value_mask & CWWidth) {
-				c->oldw = c->w;
+				c->cold->oldw = c->w;
 				c->w = ev->width;
 			}
 			if (ev->value_mask & CWHeight) {
-				c->oldh = c->h;
+				c->cold->oldh = c->h;
 				c->h = ev->height;
 			}
 			if ((c->x + c->w) > m->mx + m->mw && c->isfloating)
@@ -763,7 +1147,7 @@ createmon(void)
 {
 	Monitor *m;
 
-	m = ecalloc(1, sizeof(Monitor));
+	m = poolalloc(&monpool);
 	m->tagset[0] = m->tagset[1] = 1;
 	m->mfact = mfact;
 	m->nmaster = nmaster;
@@ -789,25 +1173,36 @@ destroynotify(XEvent *e)
 		unmanage(c, 1);
 
 	else if ((c = swallowingclient(ev->window)))
-		unmanage(c->swallowing, 1);
+		unmanage(SWALLOWED(c), 1);
 }
 
 void
 detach(Client *c)
 {
-	Client **tc;
-
-	for (tc = &c->mon->clients; *tc && *tc != c; tc = &(*tc)->next);
-	*tc = c->next;
+	if (c->prev)
+		c->prev->next = c->next;
+	else
+		c->mon->clients = c->next;
+	if (c->next)
+		c->next->prev = c->prev;
+	else
+		c->mon->last = c->prev;
+	c->next = c->prev = NULL;
+	tagcount(c, -1);
 }
 
 void
 detachstack(Client *c)
 {
-	Client **tc, *t;
+	Client *t;
 
-	for (tc = &c->mon->stack; *tc && *tc != c; tc = &(*tc)->snext);
-	*tc = c->snext;
+	if (c->sprev)
+		c->sprev->snext = c->snext;
+	else
+		c->mon->stack = c->snext;
+	if (c->snext)
+		c->snext->sprev = c->sprev;
+	c->snext = c->sprev = NULL;
 
 	if (c == c->mon->sel) {
 		for (t = c->mon->stack; t && !ISVISIBLE(t); t = t->snext);
@@ -836,65 +1231,52 @@ drawbar(Monitor *m)
 	int x, w, tw = 0;
 	int boxs = drw->fonts->h / 9;
 	int boxw = drw->fonts->h / 6 + 2;
-	unsigned int i, occ = 0, urg = 0;
-	Client *c;
+	unsigned int i;
 
 	if (!m->showbar)
 		return;
+	SPANBEGIN("drawbar");
 
 	/* draw status first so it can be overdrawn by tags later */
 	if (m == selmon) { /* status is only drawn on selected monitor */
-		char *text, *s, ch;
 		drw_setscheme(drw, scheme[SchemeStatus]);
-
-		x = 0;
-		for (text = s = stext; *s; s++) {
-			if ((unsigned char)(*s) < ' ') {
-				ch = *s;
-				*s = '\0';
-				tw = TEXTW(text) - lrpad;
-				drw_text(drw, m->ww - statusw + x, 0, tw, bh, 0, text, 0);
-				x += tw;
-				*s = ch;
-				text = s + 1;
-			}
+		x = m->ww - statusw;
+		for (i = 0; i < nstatusblocks; i++) {
+			w = statusblocks[i].w + (i == nstatusblocks - 1 ? 2 : 0);
+			drw_text(drw, x, 0, w, bh, 0, statusblocks[i].text, 0);
+			x += w;
 		}
-		tw = TEXTW(text) - lrpad + 2;
-		drw_text(drw, m->ww - statusw + x, 0, tw, bh, 0, text, 0);
 		tw = statusw;
 	}
 
-	for (c = m->clients; c; c = c->next) {
-		occ |= c->tags == TAGMASK ? 0 : c->tags;
-		if (c->isurgent)
-			urg |= c->tags;
-	}
 	x = 0;
 	for (i = 0; i < LENGTH(tags); i++) {
 		/* Do not draw vacant tags */
-		if(!(occ & 1 << i || m->tagset[m->seltags] & 1 << i))
+		if(!(m->occ & 1 << i || m->tagset[m->seltags] & 1 << i))
 			continue;
 		w = TEXTW(tags[i]);
 		drw_setscheme(drw, scheme[m->tagset[m->seltags] & 1 << i ? SchemeTagsSel : SchemeTagsNorm]);
-		drw_text(drw, x, 0, w, bh, lrpad / 2, tags[i], urg & 1 << i);
+		drw_text(drw, x, 0, w, bh, lrpad / 2, tags[i], m->urg & 1 << i);
 		x += w;
 	}
 	w = TEXTW(m->ltsymbol);
 	drw_setscheme(drw, scheme[SchemeTagsNorm]);
 	x = drw_text(drw, x, 0, w, bh, lrpad / 2, m->ltsymbol, 0);
+	m->titlex = x;
 
 	if ((w = m->ww - tw - x) > bh) {
 		if (m->sel) {
 			drw_setscheme(drw, scheme[m == selmon ? SchemeInfoSel : SchemeInfoNorm]);
-			drw_text(drw, x, 0, w, bh, lrpad / 2, m->sel->name, 0);
+			drw_text(drw, x, 0, w, bh, lrpad / 2, m->sel->cold->name, 0);
 			if (m->sel->isfloating)
-				drw_rect(drw, x + boxs, boxs, boxw, boxw, m->sel->isfixed, 0);
+				drw_rect(drw, x + boxs, boxs, boxw, boxw, m->sel->cold->isfixed, 0);
 		} else {
 			drw_setscheme(drw, scheme[SchemeInfoNorm]);
 			drw_rect(drw, x, 0, w, bh, 1, 1);
 		}
 	}
 	drw_map(drw, m->barwin, 0, 0, m->ww, bh);
+	SPANEND("drawbar");
 }
 
 void
@@ -906,6 +1288,26 @@ drawbars(void)
 		drawbar(m);
 }
 
+/* repaints status block i alone, which is only valid while statusw and the
+ * widths of the blocks before it are unchanged */
+void
+drawstatusblock(unsigned int i)
+{
+	int x = selmon->ww - statusw, w;
+	unsigned int j;
+
+	for (j = 0; j < i; j++)
+		x += statusblocks[j].w;
+	if (!selmon->showbar || x < selmon->titlex) {
+		drawbar(selmon); /* tags overlap the status */
+		return;
+	}
+	w = statusblocks[i].w + (i == nstatusblocks - 1 ? 2 : 0);
+	drw_setscheme(drw, scheme[SchemeStatus]);
+	drw_text(drw, x, 0, w, bh, 0, statusblocks[i].text, 0);
+	drw_map(drw, selmon->barwin, x, 0, w, bh);
+}
+
 void
 enternotify(XEvent *e)
 {
@@ -935,9 +1337,30 @@ expose(XEvent *e)
 		drawbar(m);
 }
 
+/* keeps stpoolsize spare terminals running on the hidden POOLTAG */
+void
+fillspares(void)
+{
+	Arg a = { .v = stpoolcmd };
+	Client *c;
+	Monitor *m;
+	int n;
+
+	if (sparespending && nowms() - sparesat > 10000)
+		sparespending = 0; /* they never showed up */
+	for (n = sparespending, m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			n += c->tags == POOLTAG;
+	for (; n < stpoolsize; n++, sparespending++) {
+		spawn(&a);
+		sparesat = nowms();
+	}
+}
+
 void
 focus(Client *c)
 {
+	SPANBEGIN("focus");
 	if (!c || !ISVISIBLE(c))
 		for (c = selmon->stack; c && !ISVISIBLE(c); c = c->snext);
 	if (selmon->sel && selmon->sel != c)
@@ -947,8 +1370,8 @@ focus(Client *c)
 			selmon = c->mon;
 		if (c->isurgent)
 			seturgent(c, 0);
-		detachstack(c);
-		attachstack(c);
+		focustop(c);
+		applypending(c);
 		grabbuttons(c, 1);
 		XSetWindowBorder(dpy, c->win, scheme[SchemeSel][ColBorder].pixel);
 		setfocus(c);
@@ -958,6 +1381,7 @@ focus(Client *c)
 	}
 	selmon->sel = c;
 	drawbars();
+	SPANEND("focus");
 }
 
 /* there are some broken focus acquiring clients needing extra handling */
@@ -987,7 +1411,7 @@ focusmon(const Arg *arg)
 void
 focusstack(const Arg *arg)
 {
-	Client *c = NULL, *i;
+	Client *c = NULL;
 
 	if (!selmon->sel || (selmon->sel->isfullscreen && lockfullscreen))
 		return;
@@ -996,13 +1420,9 @@ focusstack(const Arg *arg)
 		if (!c)
 			for (c = selmon->clients; c && !ISVISIBLE(c); c = c->next);
 	} else {
-		for (i = selmon->clients; i != selmon->sel; i = i->next)
-			if (ISVISIBLE(i))
-				c = i;
+		for (c = selmon->sel->prev; c && !ISVISIBLE(c); c = c->prev);
 		if (!c)
-			for (; i; i = i->next)
-				if (ISVISIBLE(i))
-					c = i;
+			for (c = selmon->last; c && !ISVISIBLE(c); c = c->prev);
 	}
 	if (c) {
 		focus(c);
@@ -1010,67 +1430,96 @@ focusstack(const Arg *arg)
 	}
 }
 
+/* moves c to the top of its monitor's focus stack */
+void
+focustop(Client *c)
+{
+	if (c == c->mon->stack)
+		return;
+	c->sprev->snext = c->snext;
+	if (c->snext)
+		c->snext->sprev = c->sprev;
+	attachstack(c);
+}
+
+void
+freeclient(Client *c)
+{
+	rulematchfree(c->cold->rm);
+	poolfree(&coldpool, c->cold);
+	poolfree(&clientpool, c);
+}
+
 Atom
 getatomprop(Client *c, Atom prop)
 {
-	int di;
+	int di, r;
 	unsigned long dl;
 	unsigned char *p = NULL;
 	Atom da, atom = None;
 
-	if (XGetWindowProperty(dpy, c->win, prop, 0L, sizeof atom, False, XA_ATOM,
-		&da, &di, &dl, &dl, &p) == Success && p) {
+	SPANBEGIN("XGetWindowProperty");
+	r = XGetWindowProperty(dpy, c->win, prop, 0L, sizeof atom, False, XA_ATOM,
+		&da, &di, &dl, &dl, &p);
+	SPANEND("XGetWindowProperty");
+	if (r == Success && p) {
 		atom = *(Atom *)p;
 		XFree(p);
 	}
 	return atom;
 }
 
+/* finds the status bar process, trying the cached pid first; runs on the
+ * worker since it reads /proc */
 pid_t
-getstatusbarpid(void)
+getstatusbarpid(pid_t cached)
 {
-	char buf[32], *str = buf, *c;
-	FILE *fp;
-
-	if (statuspid > 0) {
-		snprintf(buf, sizeof(buf), "/proc/%u/cmdline", statuspid);
-		if ((fp = fopen(buf, "r"))) {
-			fgets(buf, sizeof(buf), fp);
-			while ((c = strchr(str, '/')))
-				str = c + 1;
-			fclose(fp);
-			if (!strcmp(str, STATUSBAR))
-				return statuspid;
-		}
+	char buf[16], *end;
+	struct dirent *de;
+	DIR *dir;
+	pid_t pid = -1;
+
+	if (cached > 0) {
+		snprintf(buf, sizeof(buf), "%d", cached);
+		if (isstatusbar(buf))
+			return cached;
 	}
-	if (!(fp = popen("pidof -s "STATUSBAR, "r")))
+	if (!(dir = opendir("/proc")))
 		return -1;
-	fgets(buf, sizeof(buf), fp);
-	pclose(fp);
-	return strtol(buf, NULL, 10);
+	while (pid == -1 && (de = readdir(dir)))
+		if (strtol(de->d_name, &end, 10) > 0 && !*end && isstatusbar(de->d_name))
+			pid = strtol(de->d_name, NULL, 10);
+	closedir(dir);
+	return pid;
 }
 
 int
 getrootptr(int *x, int *y)
 {
-	int di;
+	int di, r;
 	unsigned int dui;
 	Window dummy;
 
-	return XQueryPointer(dpy, root, &dummy, &dummy, x, y, &di, &di, &dui);
+	SPANBEGIN("XQueryPointer");
+	r = XQueryPointer(dpy, root, &dummy, &dummy, x, y, &di, &di, &dui);
+	SPANEND("XQueryPointer");
+	return r;
 }
 
 long
 getstate(Window w)
 {
-	int format;
+	int format, r;
 	long result = -1;
 	unsigned char *p = NULL;
 	unsigned long n, extra;
 	Atom real;
 
-	if (XGetWindowProperty(dpy, w, wmatom[WMState], 0L, 2L, False, wmatom[WMState],
-		&real, &format, &n, &extra, (unsigned char **)&p) != Success)
+	SPANBEGIN("XGetWindowProperty");
+	r = XGetWindowProperty(dpy, w, wmatom[WMState], 0L, 2L, False, wmatom[WMState],
+		&real, &format, &n, &extra, (unsigned char **)&p);
+	SPANEND("XGetWindowProperty");
+	if (r != Success)
 		return -1;
 	if (n != 0)
 		result = *p;
@@ -1088,7 +1537,10 @@ gettextprop(Window w, Atom atom, char *text, unsigned int size)
 	if (!text || size == 0)
 		return 0;
 	text[0] = '\0';
-	if (!XGetTextProperty(dpy, w, &name, atom) || !name.nitems)
+	SPANBEGIN("XGetTextProperty");
+	n = XGetTextProperty(dpy, w, &name, atom);
+	SPANEND("XGetTextProperty");
+	if (!n || !name.nitems)
 		return 0;
 	if (name.encoding == XA_STRING) {
 		strncpy(text, (char *)name.value, size - 1);
@@ -1104,7 +1556,9 @@ gettextprop(Window w, Atom atom, char *text, unsigned int size)
 void
 grabbuttons(Client *c, int focused)
 {
-	updatenumlockmask();
+	if (c->grabstate == (focused ? 2 : 1))
+		return;
+	c->grabstate = focused ? 2 : 1;
 	{
 		unsigned int i, j;
 		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
@@ -1122,32 +1576,75 @@ grabbuttons(Client *c, int focused)
 	}
 }
 
+/* rebuilds the keycode dispatch table and only sends the grabs that changed,
+ * unless the numlock mask changed and every grab has to be redone */
 void
 grabkeys(void)
 {
-	updatenumlockmask();
-	{
-		unsigned int i, j, k;
-		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-		int start, end, skip;
-		KeySym *syms;
+	static unsigned char oldtable[256][128];
+	static unsigned char keysorted[LENGTH(keys)];
+	static unsigned int grabnumlock;
+	static int grabbed = 0;
+	unsigned int i, j, k, l, h, mid, m, mask, full;
+	unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+	int start, end, skip;
+	KeySym *syms, sym;
+
+	XDisplayKeycodes(dpy, &start, &end);
+	syms = XGetKeyboardMapping(dpy, start, end - start + 1, &skip);
+	if (!syms)
+		return;
+	if (!grabbed) {
+		for (i = 0; i < LENGTH(keys); i++)
+			keysorted[i] = i;
+		qsort(keysorted, LENGTH(keys), sizeof keysorted[0], keycmp);
+	}
+	/* chain bindings sharing keysym and modifiers, in keys[] order */
+	for (l = 0; l < LENGTH(keys); l++)
+		for (keydup[keysorted[l]] = 0, h = l + 1; h < LENGTH(keys)
+		&& keys[keysorted[h]].keysym == keys[keysorted[l]].keysym; h++)
+			if (CLEANMASK(keys[keysorted[h]].mod) == CLEANMASK(keys[keysorted[l]].mod)) {
+				keydup[keysorted[l]] = keysorted[h] + 1;
+				break;
+			}
+	memcpy(oldtable, keytable, sizeof keytable);
+	memset(keytable, 0, sizeof keytable);
+	for (k = start; k <= end; k++) {
+		/* skip modifier codes, we do that ourselves */
+		sym = syms[(k - start) * skip];
+		for (l = 0, h = LENGTH(keys); l < h;) {
+			mid = (l + h) / 2;
+			if (keys[keysorted[mid]].keysym < sym)
+				l = mid + 1;
+			else
+				h = mid;
+		}
+		for (; l < LENGTH(keys) && keys[keysorted[l]].keysym == sym; l++) {
+			i = keysorted[l];
+			m = KEYMODIDX(CLEANMASK(keys[i].mod));
+			if (!keytable[k][m])
+				keytable[k][m] = i + 1;
+		}
+	}
+	XFree(syms);
 
+	full = !grabbed || grabnumlock != numlockmask;
+	if (full)
 		XUngrabKey(dpy, AnyKey, AnyModifier, root);
-		XDisplayKeycodes(dpy, &start, &end);
-		syms = XGetKeyboardMapping(dpy, start, end - start + 1, &skip);
-		if (!syms)
-			return;
-		for (k = start; k <= end; k++)
-			for (i = 0; i < LENGTH(keys); i++)
-				/* skip modifier codes, we do that ourselves */
-				if (keys[i].keysym == syms[(k - start) * skip])
-					for (j = 0; j < LENGTH(modifiers); j++)
-						XGrabKey(dpy, k,
-							 keys[i].mod | modifiers[j],
-							 root, True,
-							 GrabModeAsync, GrabModeAsync);
-		XFree(syms);
-	}
+	for (k = start; k <= end; k++)
+		for (m = 0; m < LENGTH(keytable[k]); m++) {
+			if (!full && !keytable[k][m] == !oldtable[k][m])
+				continue;
+			mask = (m & ShiftMask) | (m & 0x7e) << 1; /* inverse of KEYMODIDX */
+			for (j = 0; j < LENGTH(modifiers); j++)
+				if (keytable[k][m])
+					XGrabKey(dpy, k, mask | modifiers[j], root, True,
+						GrabModeAsync, GrabModeAsync);
+				else if (!full)
+					XUngrabKey(dpy, k, mask | modifiers[j], root);
+		}
+	grabbed = 1;
+	grabnumlock = numlockmask;
 }
 
 void
@@ -1157,6 +1654,31 @@ incnmaster(const Arg *arg)
 	arrange(selmon);
 }
 
+/* whether the selected client is fullscreen and hides the tiled ones */
+int
+iscovered(Monitor *m)
+{
+	return m->sel && m->sel->isfullscreen && ISVISIBLE(m->sel);
+}
+
+/* whether /proc/<pid>/cmdline names STATUSBAR */
+int
+isstatusbar(const char *pid)
+{
+	char buf[64], *str = buf, *c;
+	FILE *fp;
+
+	snprintf(buf, sizeof(buf), "/proc/%s/cmdline", pid);
+	if (!(fp = fopen(buf, "r")))
+		return 0;
+	if (!fgets(buf, sizeof(buf), fp))
+		buf[0] = '\0';
+	fclose(fp);
+	while ((c = strchr(str, '/')))
+		str = c + 1;
+	return !strcmp(str, STATUSBAR);
+}
+
 #ifdef XINERAMA
 static int
 isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
@@ -1169,20 +1691,27 @@ isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
 }
 #endif /* XINERAMA */
 
+/* orders keys[] indices by keysym, then by position */
+int
+keycmp(const void *a, const void *b)
+{
+	const Key *ka = &keys[*(const unsigned char *)a], *kb = &keys[*(const unsigned char *)b];
+
+	if (ka->keysym != kb->keysym)
+		return ka->keysym < kb->keysym ? -1 : 1;
+	return ka < kb ? -1 : ka > kb;
+}
+
 void
 keypress(XEvent *e)
 {
 	unsigned int i;
-	KeySym keysym;
 	XKeyEvent *ev;
 
 	ev = &e->xkey;
-	keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
-	for (i = 0; i < LENGTH(keys); i++)
-		if (keysym == keys[i].keysym
-		&& CLEANMASK(keys[i].mod) == CLEANMASK(ev->state)
-		&& keys[i].func)
-			keys[i].func(&(keys[i].arg));
+	for (i = keytable[ev->keycode & 0xff][KEYMODIDX(CLEANMASK(ev->state))]; i; i = keydup[i - 1])
+		if (keys[i - 1].func)
+			keys[i - 1].func(&(keys[i - 1].arg));
 }
 
 void
@@ -1190,7 +1719,9 @@ killclient(const Arg *arg)
 {
 	if (!selmon->sel)
 		return;
-	if (!sendevent(selmon->sel, wmatom[WMDelete])) {
+	if (!sendevent(selmon->sel, WMDelete)) {
+		if (replayfp) /* the dummy windows are our own */
+			return;
 		XGrabServer(dpy);
 		XSetErrorHandler(xerrordummy);
 		XSetCloseDownMode(dpy, DestroyAll);
@@ -1201,63 +1732,75 @@ killclient(const Arg *arg)
 	}
 }
 
+/* counts the launch of a process spawn() started once its window is managed */
+void
+launched(pid_t pid, long long at)
+{
+	unsigned int i;
+
+	for (i = 0; i < LENGTH(launches); i++)
+		if (pid > 0 && launches[i].pid == pid) {
+			timing(&launchtime, at - launches[i].at);
+			launches[i].pid = 0;
+			return;
+		}
+}
+
+/* reads RESOURCE_MANAGER through our own connection; the string cached by
+ * XOpenDisplay would be stale after xrdb -merge */
 void
 loadxrdb(void)
 {
-	Display *display;
-	char *resm;
+	Atom actual;
+	int format;
+	unsigned long n, extra;
+	unsigned char *resm = NULL;
 	XrmDatabase xrdb;
 	char *type;
 	XrmValue value;
 
-	display = XOpenDisplay(NULL);
-
-	if (display != NULL) {
-		resm = XResourceManagerString(display);
-
-		if (resm != NULL) {
-			xrdb = XrmGetStringDatabase(resm);
-
-			if (xrdb != NULL) {
-				XRDB_LOAD_COLOR("dwm.normfgcolor",     col_normfg);
-				XRDB_LOAD_COLOR("dwm.normbgcolor",     col_normbg);
-				XRDB_LOAD_COLOR("dwm.normbordercolor", col_normborder);
-				XRDB_LOAD_COLOR("dwm.selfgcolor",      col_selfg);
-				XRDB_LOAD_COLOR("dwm.selbgcolor",      col_selbg);
-				XRDB_LOAD_COLOR("dwm.selbordercolor",  col_selborder);
-				XRDB_LOAD_COLOR("dwm.statusfgcolor",   col_statusfg);
-				XRDB_LOAD_COLOR("dwm.statusbgcolor",   col_statusbg);
-				XRDB_LOAD_COLOR("dwm.tagsselfgcolor",  col_tagsselfg);
-				XRDB_LOAD_COLOR("dwm.tagsselbgcolor",  col_tagsselbg);
-				XRDB_LOAD_COLOR("dwm.tagsnormfgcolor", col_tagsnormfg);
-				XRDB_LOAD_COLOR("dwm.tagsnormbgcolor", col_tagsnormbg);
-				XRDB_LOAD_COLOR("dwm.infoselfgcolor",  col_infoselfg);
-				XRDB_LOAD_COLOR("dwm.infoselbgcolor",  col_infoselbg);
-				XRDB_LOAD_COLOR("dwm.infonormfgcolor", col_infonormfg);
-				XRDB_LOAD_COLOR("dwm.infonormbgcolor", col_infonormbg);
-			}
-		}
+	if (XGetWindowProperty(dpy, DefaultRootWindow(dpy), XA_RESOURCE_MANAGER, 0L, 0x1fffffffL,
+		False, XA_STRING, &actual, &format, &n, &extra, &resm) != Success || !resm)
+		return;
+	if ((xrdb = XrmGetStringDatabase((char *)resm)) != NULL) {
+		XRDB_LOAD_COLOR("dwm.normfgcolor",     col_normfg);
+		XRDB_LOAD_COLOR("dwm.normbgcolor",     col_normbg);
+		XRDB_LOAD_COLOR("dwm.normbordercolor", col_normborder);
+		XRDB_LOAD_COLOR("dwm.selfgcolor",      col_selfg);
+		XRDB_LOAD_COLOR("dwm.selbgcolor",      col_selbg);
+		XRDB_LOAD_COLOR("dwm.selbordercolor",  col_selborder);
+		XRDB_LOAD_COLOR("dwm.statusfgcolor",   col_statusfg);
+		XRDB_LOAD_COLOR("dwm.statusbgcolor",   col_statusbg);
+		XRDB_LOAD_COLOR("dwm.tagsselfgcolor",  col_tagsselfg);
+		XRDB_LOAD_COLOR("dwm.tagsselbgcolor",  col_tagsselbg);
+		XRDB_LOAD_COLOR("dwm.tagsnormfgcolor", col_tagsnormfg);
+		XRDB_LOAD_COLOR("dwm.tagsnormbgcolor", col_tagsnormbg);
+		XRDB_LOAD_COLOR("dwm.infoselfgcolor",  col_infoselfg);
+		XRDB_LOAD_COLOR("dwm.infoselbgcolor",  col_infoselbg);
+		XRDB_LOAD_COLOR("dwm.infonormfgcolor", col_infonormfg);
+		XRDB_LOAD_COLOR("dwm.infonormbgcolor", col_infonormbg);
+		XrmDestroyDatabase(xrdb);
 	}
-
-	XCloseDisplay(display);
+	XFree(resm);
 }
 
 void
 manage(Window w, XWindowAttributes *wa)
 {
-	Client *c, *t = NULL, *term = NULL;
+	Client *c, *t = NULL;
 	Window trans = None;
 	XWindowChanges wc;
 
-	c = ecalloc(1, sizeof(Client));
+	SPANBEGIN("manage");
+	c = poolalloc(&clientpool);
+	c->cold = poolalloc(&coldpool);
 	c->win = w;
-	c->pid = winpid(w);
 	/* geometry */
-	c->x = c->oldx = wa->x;
-	c->y = c->oldy = wa->y;
-	c->w = c->oldw = wa->width;
-	c->h = c->oldh = wa->height;
-	c->oldbw = wa->border_width;
+	c->x = c->cold->oldx = wa->x;
+	c->y = c->cold->oldy = wa->y;
+	c->w = c->cold->oldw = wa->width;
+	c->h = c->cold->oldh = wa->height;
+	c->cold->oldbw = wa->border_width;
 	c->cfact = 1.0;
 
 	updatetitle(c);
@@ -1267,7 +1810,8 @@ manage(Window w, XWindowAttributes *wa)
 	} else {
 		c->mon = selmon;
 		applyrules(c);
-		term = termforwin(c);
+		if (!c->tags)
+			c->tags = c->mon->tagset[c->mon->seltags];
 	}
 
 	if (c->x + WIDTH(c) > c->mon->wx + c->mon->ww)
@@ -1284,37 +1828,63 @@ manage(Window w, XWindowAttributes *wa)
 	configure(c); /* propagates border_width, if size doesn't change */
 	updatewindowtype(c);
 	updatesizehints(c);
-	updatewmhints(c);
-	XSelectInput(dpy, w, EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
+	XSelectInput(dpy, w, CLIENTMASK);
 	grabbuttons(c, 0);
 	if (!c->isfloating)
-		c->isfloating = c->oldstate = trans != None || c->isfixed;
+		c->isfloating = c->cold->oldstate = trans != None || c->cold->isfixed;
 	if (c->isfloating)
 		XRaiseWindow(dpy, c->win);
 	attach(c);
 	attachstack(c);
-	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
-		(unsigned char *) &(c->win), 1);
+	updatewmhints(c); /* urgency is counted per tag once attached */
+	updateclientlist();
 	XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h); /* some windows require this */
-	setclientstate(c, NormalState);
+	c->ishidden = 1;
+	/* a window for a hidden tag is not mapped at all with hiddenunmap, one
+	 * that already is (scan) gets unmapped by showhide; spares stay mapped */
+	c->isiconic = hiddenunmap && c->tags != POOLTAG && !ISVISIBLE(c)
+		&& wa->map_state != IsViewable;
+	setclientstate(c, c->isiconic ? IconicState : NormalState);
 	if (c->mon == selmon)
 		unfocus(selmon->sel, 0);
 	c->mon->sel = c;
 	arrange(c->mon);
-	XMapWindow(dpy, c->win);
-	if (term)
-		swallow(term, c);
+	if (!c->isiconic)
+		XMapWindow(dpy, c->win);
+	/* after selecting PropertyChangeMask, so no change is missed, and after
+	 * mapping, an unmapped client would not answer sync requests */
+	updateprotocols(c);
+	queueswallow(c, !t && !c->isterminal && !c->noswallow);
 	focus(NULL);
+	if (c->tags == POOLTAG) {
+		sparespending -= sparespending > 0;
+		if (scratchwanted) {
+			scratchwanted = 0;
+			togglescratch(NULL);
+		}
+	}
+	SPANEND("manage");
 }
 
 void
 mappingnotify(XEvent *e)
 {
 	XMappingEvent *ev = &e->xmapping;
+	unsigned int oldnumlock = numlockmask;
+	Client *c;
+	Monitor *m;
 
 	XRefreshKeyboardMapping(ev);
-	if (ev->request == MappingKeyboard)
+	if (ev->request == MappingKeyboard || ev->request == MappingModifier) {
+		updatenumlockmask();
 		grabkeys();
+		if (numlockmask != oldnumlock) /* button grabs include numlock variants */
+			for (m = mons; m; m = m->next)
+				for (c = m->clients; c; c = c->next) {
+					c->grabstate = 0;
+					grabbuttons(c, c == selmon->sel);
+				}
+	}
 }
 
 void
@@ -1322,8 +1892,12 @@ maprequest(XEvent *e)
 {
 	static XWindowAttributes wa;
 	XMapRequestEvent *ev = &e->xmaprequest;
+	int r;
 
-	if (!XGetWindowAttributes(dpy, ev->window, &wa) || wa.override_redirect)
+	SPANBEGIN("XGetWindowAttributes");
+	r = XGetWindowAttributes(dpy, ev->window, &wa);
+	SPANEND("XGetWindowAttributes");
+	if (!r || wa.override_redirect)
 		return;
 	if (!wintoclient(ev->window))
 		manage(ev->window, &wa);
@@ -1341,7 +1915,8 @@ monocle(Monitor *m)
 	if (n > 0) /* override layout symbol */
 		snprintf(m->ltsymbol, sizeof m->ltsymbol, "[%d]", n);
 	for (c = nexttiled(m->clients); c; c = nexttiled(c->next))
-		resize(c, m->wx, m->wy, m->ww - 2 * c->bw, m->wh - 2 * c->bw, 0);
+		setpending(c, m->wx, m->wy, m->ww - 2 * c->bw, m->wh - 2 * c->bw);
+	showpending(m);
 }
 
 void
@@ -1361,10 +1936,19 @@ motionnotify(XEvent *e)
 	mon = m;
 }
 
+/* matches queued motion events, but none queued after a button release */
+Bool
+motionpending(Display *dpy, XEvent *ev, XPointer arg)
+{
+	if (ev->type == ButtonRelease)
+		*(int *)arg = 1;
+	return !*(int *)arg && ev->type == MotionNotify;
+}
+
 void
 movemouse(const Arg *arg)
 {
-	int x, y, ocx, ocy, nx, ny;
+	int x, y, ocx, ocy, nx, ny, px = 0, py = 0, released, pending = 0;
 	Client *c;
 	Monitor *m;
 	XEvent ev;
@@ -1383,35 +1967,52 @@ movemouse(const Arg *arg)
 	if (!getrootptr(&x, &y))
 		return;
 	do {
-		XMaskEvent(dpy, MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
+		nextevent(MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
 		switch(ev.type) {
 		case ConfigureRequest:
 		case Expose:
 		case MapRequest:
 			handler[ev.type](&ev);
-			break;
+			continue;
 		case MotionNotify:
-			if ((ev.xmotion.time - lasttime) <= (1000 / 60))
+#ifdef XSYNC
+			syncdrain();
+#endif /* XSYNC */
+			/* skip stale positions, only the newest one matters */
+			released = 0;
+			while (checkmotion(&ev, &released));
+			px = ev.xmotion.x;
+			py = ev.xmotion.y;
+			if ((ev.xmotion.time - lasttime) <= motioninterval) {
+				pending = 1;
 				continue;
+			}
 			lasttime = ev.xmotion.time;
-
-			nx = ocx + (ev.xmotion.x - x);
-			ny = ocy + (ev.xmotion.y - y);
-			if (abs(selmon->wx - nx) < snap)
-				nx = selmon->wx;
-			else if (abs((selmon->wx + selmon->ww) - (nx + WIDTH(c))) < snap)
-				nx = selmon->wx + selmon->ww - WIDTH(c);
-			if (abs(selmon->wy - ny) < snap)
-				ny = selmon->wy;
-			else if (abs((selmon->wy + selmon->wh) - (ny + HEIGHT(c))) < snap)
-				ny = selmon->wy + selmon->wh - HEIGHT(c);
-			if (!c->isfloating && selmon->lt[selmon->sellt]->arrange
-			&& (abs(nx - c->x) > snap || abs(ny - c->y) > snap))
-				togglefloating(NULL);
-			if (!selmon->lt[selmon->sellt]->arrange || c->isfloating)
-				resize(c, nx, ny, c->w, c->h, 1);
 			break;
+		case ButtonRelease:
+			if (!pending) /* land on the last throttled position */
+				continue;
+			break;
+		default:
+			continue;
 		}
+		pending = 0;
+
+		nx = ocx + (px - x);
+		ny = ocy + (py - y);
+		if (abs(selmon->wx - nx) < snap)
+			nx = selmon->wx;
+		else if (abs((selmon->wx + selmon->ww) - (nx + WIDTH(c))) < snap)
+			nx = selmon->wx + selmon->ww - WIDTH(c);
+		if (abs(selmon->wy - ny) < snap)
+			ny = selmon->wy;
+		else if (abs((selmon->wy + selmon->wh) - (ny + HEIGHT(c))) < snap)
+			ny = selmon->wy + selmon->wh - HEIGHT(c);
+		if (!c->isfloating && selmon->lt[selmon->sellt]->arrange
+		&& (abs(nx - c->x) > snap || abs(ny - c->y) > snap))
+			togglefloating(NULL);
+		if (!selmon->lt[selmon->sellt]->arrange || c->isfloating)
+			resize(c, nx, ny, c->w, c->h, 1);
 	} while (ev.type != ButtonRelease);
 	XUngrabPointer(dpy, CurrentTime);
 	if ((m = recttomon(c->x, c->y, c->w, c->h)) != selmon) {
@@ -1421,6 +2022,30 @@ movemouse(const Arg *arg)
 	}
 }
 
+/* sends the client's geometry to the server; while the client still paints
+ * an earlier size it is held back, so only the newest one is sent after */
+void
+moveresize(Client *c, int resized)
+{
+	XWindowChanges wc;
+
+#ifdef XSYNC
+	if (c->cold->syncwait) {
+		c->cold->syncdirty = 1;
+		return;
+	}
+	if (resized && c->cold->synccounter != None)
+		syncrequest(c);
+#endif /* XSYNC */
+	wc.x = c->x;
+	wc.y = c->y;
+	wc.width = c->w;
+	wc.height = c->h;
+	wc.border_width = c->bw;
+	XConfigureWindow(dpy, c->win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
+	configure(c);
+}
+
 Client *
 nexttiled(Client *c)
 {
@@ -1428,6 +2053,21 @@ nexttiled(Client *c)
 	return c;
 }
 
+long long
+nowms(void)
+{
+	return nowus() / 1000;
+}
+
+long long
+nowus(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
 void
 pop(Client *c)
 {
@@ -1439,12 +2079,8 @@ pop(Client *c)
 
 Client *
 prevtiled(Client *c) {
-	Client *p, *r;
-
-	for(p = selmon->clients, r = NULL; p && p != c; p = p->next)
-		if(!p->isfloating && ISVISIBLE(p))
-			r = p;
-	return r;
+	for (c = c->prev; c && (c->isfloating || !ISVISIBLE(c)); c = c->prev);
+	return c;
 }
 
 void
@@ -1456,8 +2092,9 @@ propertynotify(XEvent *e)
 
 	if ((ev->window == root) && (ev->atom == XA_WM_NAME))
 		updatestatus();
-	else if (ev->state == PropertyDelete)
-		return; /* ignore */
+	else if (ev->state == PropertyDelete
+	&& ev->atom != XA_WM_HINTS && ev->atom != wmatom[WMProtocols])
+		return; /* ignore, except where a cached property went away */
 	else if ((c = wintoclient(ev->window))) {
 		switch(ev->atom) {
 		default: break;
@@ -1467,12 +2104,15 @@ propertynotify(XEvent *e)
 				arrange(c->mon);
 			break;
 		case XA_WM_NORMAL_HINTS:
-			c->hintsvalid = 0;
+			c->cold->hintsvalid = 0;
 			break;
 		case XA_WM_HINTS:
 			updatewmhints(c);
 			drawbars();
 			break;
+		case XA_WM_CLASS:
+			reapplyrules(c);
+			break;
 		}
 		if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) {
 			updatetitle(c);
@@ -1481,7 +2121,27 @@ propertynotify(XEvent *e)
 		}
 		if (ev->atom == netatom[NetWMWindowType])
 			updatewindowtype(c);
+		else if (ev->atom == wmatom[WMProtocols])
+			updateprotocols(c);
+#ifdef XSYNC
+		else if (ev->atom == netatom[NetWMSyncRequestCounter])
+			updateprotocols(c); /* only used while WM_PROTOCOLS lists sync */
+#endif /* XSYNC */
+	}
+}
+
+/* moves c onto the selected monitor's current tags, without arranging */
+void
+pullclient(Client *c)
+{
+	if (c->mon != selmon) {
+		detach(c);
+		detachstack(c);
+		c->mon = selmon;
+		attach(c);
+		attachstack(c);
 	}
+	settags(c, selmon->tagset[selmon->seltags]);
 }
 
 void
@@ -1492,8 +2152,7 @@ pushdown(const Arg *arg) {
 		return;
 	if((c = nexttiled(sel->next))) {
 		detach(sel);
-		sel->next = c->next;
-		c->next = sel;
+		attachbefore(sel, c->next);
 	} else {
 		detach(sel);
 		attach(sel);
@@ -1510,47 +2169,139 @@ pushup(const Arg *arg) {
 		return;
 	if((c = prevtiled(sel))) {
 		detach(sel);
-		sel->next = c;
-		if(selmon->clients == c)
-			selmon->clients = sel;
-		else {
-			for(c = selmon->clients; c->next != sel->next; c = c->next);
-			c->next = sel;
-		}
+		attachbefore(sel, c);
 	} else {
-		for(c = sel; c->next; c = c->next);
 		detach(sel);
-		sel->next = NULL;
-		c->next = sel;
+		attachbefore(sel, NULL);
 	}
 	focus(sel);
 	arrange(selmon);
 }
 
 void
-quit(const Arg *arg)
+queuejob(Job *j)
 {
-	if(arg->i) restart = 1;
-	running = 0;
+	pthread_mutex_lock(&jobslock);
+	j->next = NULL;
+	if (lastjob)
+		lastjob->next = j;
+	else
+		jobs = j;
+	lastjob = j;
+	pthread_cond_signal(&jobscond);
+	pthread_mutex_unlock(&jobslock);
 }
 
-Monitor *
-recttomon(int x, int y, int w, int h)
+/* has the worker look up the pid of c and, if findterm, the terminal it was
+ * started from; c is swallowed once the answer is back */
+void
+queueswallow(Client *c, int findterm)
 {
-	Monitor *m, *r = selmon;
-	int a, area = 0;
+	SwallowJob *j;
+	Monitor *m;
+	Client *t;
+	unsigned int n = 0;
 
-	for (m = mons; m; m = m->next)
-		if ((a = INTERSECT(x, y, w, h, m)) > area) {
-			area = a;
-			r = m;
-		}
-	return r;
+	if (findterm)
+		for (m = mons; m; m = m->next)
+			for (t = m->clients; t; t = t->next)
+				n += t->isterminal && !SWALLOWED(t) && t->pid;
+	j = ecalloc(1, sizeof(SwallowJob) + n * sizeof(j->terms[0]));
+	j->job.run = swallowlookup;
+	j->job.done = swallowresult;
+	j->client = poolref(c);
+	j->win = c->win;
+	j->at = nowms();
+	j->term = -1;
+	if (n)
+		for (m = mons; m; m = m->next)
+			for (t = m->clients; t; t = t->next)
+				if (t->isterminal && !SWALLOWED(t) && t->pid) {
+					j->terms[j->nterms].client = poolref(t);
+					j->terms[j->nterms++].pid = t->pid;
+				}
+	queuejob(&j->job);
+}
+
+void
+quit(const Arg *arg)
+{
+	if(arg->i) restart = 1;
+	running = 0;
+}
+
+/* applies the rules to a client that changed WM_CLASS after being managed,
+ * e.g. one that only sets it once mapped; tags and monitor are only
+ * changed when a matching rule asks for them */
+void
+reapplyrules(Client *c)
+{
+	ClientCold rc = { 0 };
+	Client r = { .cold = &rc };
+	int n, same;
+
+	r.win = c->win;
+	r.mon = c->mon;
+	memcpy(rc.name, c->cold->name, sizeof rc.name);
+	n = applyrules(&r);
+	same = c->cold->rm && !strcmp(rc.rm->class, c->cold->rm->class)
+		&& !strcmp(rc.rm->instance, c->cold->rm->instance);
+	rulematchfree(c->cold->rm);
+	c->cold->rm = rc.rm;
+	if (!n || same)
+		return;
+	c->isterminal = r.isterminal;
+	c->noswallow = r.noswallow;
+	c->isfloating = c->isfloating || r.isfloating;
+	if (r.mon != c->mon)
+		sendmon(c, r.mon);
+	if (r.tags && r.tags != c->tags)
+		settags(c, r.tags);
+	focus(NULL);
+	arrange(c->mon);
+}
+
+Monitor *
+recttomon(int x, int y, int w, int h)
+{
+	Monitor *m, *r = selmon;
+	int a, area = 0;
+
+	for (m = mons; m; m = m->next)
+		if ((a = INTERSECT(x, y, w, h, m)) > area) {
+			area = a;
+			r = m;
+		}
+	return r;
+}
+
+/* recomputes the status width and repaints as little of the bar as the
+ * changes allow; last is the index of the last changed block */
+void
+redrawstatus(unsigned int nchanged, unsigned int last)
+{
+	unsigned int i;
+	int w = nstatusblocks ? 2 : 0;
+
+	for (i = 0; i < nstatusblocks; i++)
+		w += statusblocks[i].w;
+	if (!nchanged)
+		return;
+	if (nchanged == 1 && w == statusw) {
+		drawstatusblock(last);
+	} else {
+		statusw = w;
+		drawbar(selmon);
+	}
 }
 
 void
 resize(Client *c, int x, int y, int w, int h, int interact)
 {
+	if (deferlayout) {
+		setpending(c, x, y, w, h);
+		return;
+	}
 	if (applysizehints(c, &x, &y, &w, &h, interact))
 		resizeclient(c, x, y, w, h);
 }
@@ -1558,22 +2309,20 @@ resize(Client *c, int x, int y, int w, int h, int interact)
 void
 resizeclient(Client *c, int x, int y, int w, int h)
 {
-	XWindowChanges wc;
-
-	c->oldx = c->x; c->x = wc.x = x;
-	c->oldy = c->y; c->y = wc.y = y;
-	c->oldw = c->w; c->w = wc.width = w;
-	c->oldh = c->h; c->h = wc.height = h;
-	wc.border_width = c->bw;
-	XConfigureWindow(dpy, c->win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
-	configure(c);
+	c->cold->oldx = c->x; c->x = x;
+	c->cold->oldy = c->y; c->y = y;
+	c->cold->oldw = c->w; c->w = w;
+	c->cold->oldh = c->h; c->h = h;
+	c->ispending = 0;
+	c->ishidden = 0;
+	moveresize(c, w != c->cold->oldw || h != c->cold->oldh);
 	XSync(dpy, False);
 }
 
 void
 resizemouse(const Arg *arg)
 {
-	int ocx, ocy, nw, nh;
+	int ocx, ocy, nw, nh, px = 0, py = 0, released, pending = 0;
 	Client *c;
 	Monitor *m;
 	XEvent ev;
@@ -1591,31 +2340,48 @@ resizemouse(const Arg *arg)
 		return;
 	XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
 	do {
-		XMaskEvent(dpy, MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
+		nextevent(MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
 		switch(ev.type) {
 		case ConfigureRequest:
 		case Expose:
 		case MapRequest:
 			handler[ev.type](&ev);
-			break;
+			continue;
 		case MotionNotify:
-			if ((ev.xmotion.time - lasttime) <= (1000 / 60))
+#ifdef XSYNC
+			syncdrain();
+#endif /* XSYNC */
+			/* skip stale positions, only the newest one matters */
+			released = 0;
+			while (checkmotion(&ev, &released));
+			px = ev.xmotion.x;
+			py = ev.xmotion.y;
+			if ((ev.xmotion.time - lasttime) <= motioninterval) {
+				pending = 1;
 				continue;
-			lasttime = ev.xmotion.time;
-
-			nw = MAX(ev.xmotion.x - ocx - 2 * c->bw + 1, 1);
-			nh = MAX(ev.xmotion.y - ocy - 2 * c->bw + 1, 1);
-			if (c->mon->wx + nw >= selmon->wx && c->mon->wx + nw <= selmon->wx + selmon->ww
-			&& c->mon->wy + nh >= selmon->wy && c->mon->wy + nh <= selmon->wy + selmon->wh)
-			{
-				if (!c->isfloating && selmon->lt[selmon->sellt]->arrange
-				&& (abs(nw - c->w) > snap || abs(nh - c->h) > snap))
-					togglefloating(NULL);
 			}
-			if (!selmon->lt[selmon->sellt]->arrange || c->isfloating)
-				resize(c, c->x, c->y, nw, nh, 1);
+			lasttime = ev.xmotion.time;
 			break;
+		case ButtonRelease:
+			if (!pending) /* land on the last throttled size */
+				continue;
+			break;
+		default:
+			continue;
 		}
+		pending = 0;
+
+		nw = MAX(px - ocx - 2 * c->bw + 1, 1);
+		nh = MAX(py - ocy - 2 * c->bw + 1, 1);
+		if (c->mon->wx + nw >= selmon->wx && c->mon->wx + nw <= selmon->wx + selmon->ww
+		&& c->mon->wy + nh >= selmon->wy && c->mon->wy + nh <= selmon->wy + selmon->wh)
+		{
+			if (!c->isfloating && selmon->lt[selmon->sellt]->arrange
+			&& (abs(nw - c->w) > snap || abs(nh - c->h) > snap))
+				togglefloating(NULL);
+		}
+		if (!selmon->lt[selmon->sellt]->arrange || c->isfloating)
+			resize(c, c->x, c->y, nw, nh, 1);
 	} while (ev.type != ButtonRelease);
 	XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
 	XUngrabPointer(dpy, CurrentTime);
@@ -1633,34 +2399,192 @@ restack(Monitor *m)
 	Client *c;
 	XEvent ev;
 	XWindowChanges wc;
+	static Window *wins;
+	static int *pos;
+	static unsigned int size;
+	int *keep;
+	unsigned int i, j, n = 0;
 
 	drawbar(m);
 	if (!m->sel)
 		return;
+	SPANBEGIN("restack");
 	if (m->sel->isfloating || !m->lt[m->sellt]->arrange)
 		XRaiseWindow(dpy, m->sel->win);
-	if (m->lt[m->sellt]->arrange) {
-		wc.stack_mode = Below;
-		wc.sibling = m->barwin;
+	/* raises tiled clients too, and hover focus reorders without raising */
+	if (!m->lt[m->sellt]->arrange)
+		m->nstackwins = 0;
+	if (m->lt[m->sellt]->arrange && !iscovered(m)) {
 		for (c = m->stack; c; c = c->snext)
-			if (!c->isfloating && ISVISIBLE(c)) {
-				XConfigureWindow(dpy, c->win, CWSibling|CWStackMode, &wc);
-				wc.sibling = c->win;
+			if (!c->isfloating && ISVISIBLE(c))
+				n++;
+		if (n >= size) {
+			size = n + 32;
+			if (!(wins = realloc(wins, size * sizeof(Window)))
+			|| !(pos = realloc(pos, 2 * size * sizeof(int))))
+				die("realloc:");
+		}
+		keep = pos + size;
+		for (i = 0, c = m->stack; c; c = c->snext)
+			if (!c->isfloating && ISVISIBLE(c))
+				wins[i++] = c->win;
+		/* only windows outside the longest run that is already in the
+		 * wanted relative order have to be moved below their predecessor */
+		for (i = 0; i < n; i++)
+			for (pos[i] = -1, j = 0; j < m->nstackwins; j++)
+				if (m->stackwins[j] == wins[i]) {
+					pos[i] = j;
+					break;
+				}
+		stackkeep(pos, keep, n);
+		wc.stack_mode = Below;
+		for (i = 0; i < n; i++)
+			if (!keep[i] || !i) { /* the top one may sit above floating clients */
+				wc.sibling = i ? wins[i - 1] : m->barwin;
+				XConfigureWindow(dpy, wins[i], CWSibling|CWStackMode, &wc);
 			}
+		if (n >= m->stackwinscap) {
+			m->stackwinscap = size;
+			if (!(m->stackwins = realloc(m->stackwins, size * sizeof(Window))))
+				die("realloc:");
+		}
+		memcpy(m->stackwins, wins, n * sizeof(Window));
+		m->nstackwins = n;
 	}
+	SPANBEGIN("XSync");
 	XSync(dpy, False);
+	SPANEND("XSync");
 	while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
+	SPANEND("restack");
+}
+
+/* looks up, or computes and caches, the rules whose class and instance
+ * conditions hold for the given WM_CLASS; once the cache is full the result
+ * is not shared and goes with rulematchfree */
+RuleMatch *
+rulematch(const char *class, const char *instance)
+{
+	static unsigned int ncached = 0;
+	unsigned int i, h = 5381;
+	const char *p;
+	const Rule *r;
+	RuleMatch *rm;
+
+	for (p = class; *p; p++)
+		h = h * 33 + (unsigned char)*p;
+	for (p = instance; *p; p++)
+		h = h * 33 + (unsigned char)*p;
+	h %= LENGTH(rulematches);
+	for (rm = rulematches[h]; rm; rm = rm->next)
+		if (!strcmp(rm->class, class) && !strcmp(rm->instance, instance))
+			return rm;
+
+	rm = ecalloc(1, sizeof(RuleMatch));
+	rm->class = ecalloc(strlen(class) + 1, 1);
+	rm->instance = ecalloc(strlen(instance) + 1, 1);
+	strcpy(rm->class, class);
+	strcpy(rm->instance, instance);
+	if (ncached < 256) {
+		rm->iscached = 1;
+		rm->next = rulematches[h];
+		rulematches[h] = rm;
+		ncached++;
+	}
+	for (rm->n = 0, i = 0; i < LENGTH(rules); i++) {
+		r = &rules[i];
+		if ((!r->class || strstr(class, r->class))
+		&& (!r->instance || strstr(instance, r->instance)))
+			rm->rule[rm->n++] = i;
+	}
+	return rm;
+}
+
+void
+rulematchfree(RuleMatch *rm)
+{
+	if (!rm || rm->iscached)
+		return;
+	free(rm->class);
+	free(rm->instance);
+	free(rm);
 }
 
 void
 run(void)
 {
 	XEvent ev;
-	/* main event loop */
+	struct pollfd pfd[4 + IPCMAXCLIENTS];
+	long long timeout;
+#ifdef XSYNC
+	long long next;
+#endif /* XSYNC */
+
+	/* main event loop: drain the X queue, then sleep until X or ipc input */
 	XSync(dpy, False);
-	while (running && !XNextEvent(dpy, &ev))
-		if (handler[ev.type])
-			handler[ev.type](&ev); /* call handler */
+	pfd[0].fd = ConnectionNumber(dpy);
+	pfd[0].events = POLLIN;
+	pfd[2].fd = workerpipe[0];
+	pfd[2].events = POLLIN;
+	while (running) {
+		while (running && XPending(dpy)) {
+			XNextEvent(dpy, &ev);
+#ifdef XRANDR
+			if (rrevbase != -1 && ev.type == rrevbase + RRScreenChangeNotify) {
+				XRRUpdateConfiguration(&ev);
+				screenchanged();
+				continue;
+			}
+#endif /* XRANDR */
+#ifdef XSYNC
+			if (syncevbase != -1 && ev.type == syncevbase + XSyncAlarmNotify) {
+				syncnotify(&ev);
+				continue;
+			}
+#endif /* XSYNC */
+			if (ev.type < LASTEvent && handler[ev.type]) {
+				if (recordfp)
+					recordevent(&ev);
+				handler[ev.type](&ev); /* call handler */
+			}
+		}
+		timeout = -1;
+		if (screenat && (timeout = screenat - nowms()) <= 0) {
+			applyscreen();
+			continue;
+		}
+#ifdef XSYNC
+		if (nsyncwait) {
+			next = synccheck();
+			XFlush(dpy); /* geometry released by a timeout */
+			if (next && (next -= nowms(), timeout == -1 || next < timeout))
+				timeout = MAX(next, 0);
+		}
+#endif /* XSYNC */
+		if (clientlistdirty) {
+			writeclientlist();
+			XFlush(dpy);
+		}
+		ipcevents();
+#ifdef TIMELINE
+		if (timelinewanted)
+			timelinewrite();
+#endif /* TIMELINE */
+		if (!running)
+			break;
+		pfd[1].fd = statuspidfd;
+		pfd[1].events = POLLIN;
+		ipcpollfds(pfd + 3);
+		if (poll(pfd, LENGTH(pfd), (int)timeout) == -1) {
+			if (errno == EINTR)
+				continue;
+			die("poll:");
+		}
+		if (pfd[1].revents) /* the status bar exited */
+			setstatuspid(-1);
+		if (pfd[2].revents)
+			workerdone();
+		ipchandle(pfd + 3);
+	}
 }
 
 void
@@ -1690,6 +2614,14 @@ scan(void)
 	}
 }
 
+/* rotation and hotplug arrive as bursts of root ConfigureNotify and RandR
+ * events, apply only the geometry they settle on */
+void
+screenchanged(void)
+{
+	screenat = nowms() + screensettle;
+}
+
 void
 sendmon(Client *c, Monitor *m)
 {
@@ -1715,25 +2647,19 @@ setclientstate(Client *c, long state)
 		PropModeReplace, (unsigned char *)data, 2);
 }
 
+/* proto is a wmatom index, checked against the cached WM_PROTOCOLS */
 int
-sendevent(Client *c, Atom proto)
+sendevent(Client *c, int proto)
 {
-	int n;
-	Atom *protocols;
-	int exists = 0;
+	int exists = (c->protos >> proto) & 1;
 	XEvent ev;
 
-	if (XGetWMProtocols(dpy, c->win, &protocols, &n)) {
-		while (!exists && n--)
-			exists = protocols[n] == proto;
-		XFree(protocols);
-	}
 	if (exists) {
 		ev.type = ClientMessage;
 		ev.xclient.window = c->win;
 		ev.xclient.message_type = wmatom[WMProtocols];
 		ev.xclient.format = 32;
-		ev.xclient.data.l[0] = proto;
+		ev.xclient.data.l[0] = wmatom[proto];
 		ev.xclient.data.l[1] = CurrentTime;
 		XSendEvent(dpy, c->win, False, NoEventMask, &ev);
 	}
@@ -1749,32 +2675,49 @@ setfocus(Client *c)
 			XA_WINDOW, 32, PropModeReplace,
 			(unsigned char *) &(c->win), 1);
 	}
-	sendevent(c, wmatom[WMTakeFocus]);
+	sendevent(c, WMTakeFocus);
 }
 
 void
 setfullscreen(Client *c, int fullscreen)
 {
+	long bypass = 1; /* let the compositor unredirect the window */
+	unsigned char *p = NULL;
+	unsigned long n = 0, extra;
+	Atom type;
+	int format;
+
 	if (fullscreen && !c->isfullscreen) {
 		XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
 			PropModeReplace, (unsigned char*)&netatom[NetWMFullscreen], 1);
+		/* a value the client set itself, e.g. 2 to never unredirect, stays */
+		if (XGetWindowProperty(dpy, c->win, netatom[NetWMBypassCompositor], 0L, 1L,
+			False, AnyPropertyType, &type, &format, &n, &extra, &p) == Success && p)
+			XFree(p);
+		if ((c->ownbypass = !n))
+			XChangeProperty(dpy, c->win, netatom[NetWMBypassCompositor], XA_CARDINAL, 32,
+				PropModeReplace, (unsigned char *)&bypass, 1);
 		c->isfullscreen = 1;
-		c->oldstate = c->isfloating;
-		c->oldbw = c->bw;
+		c->cold->oldstate = c->isfloating;
+		c->cold->oldbw = c->bw;
 		c->bw = 0;
 		c->isfloating = 1;
 		resizeclient(c, c->mon->mx, c->mon->my, c->mon->mw, c->mon->mh);
 		XRaiseWindow(dpy, c->win);
+		c->mon->nstackwins = 0; /* restack skips covered monitors meanwhile */
 	} else if (!fullscreen && c->isfullscreen){
 		XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
 			PropModeReplace, (unsigned char*)0, 0);
+		if (c->ownbypass)
+			XDeleteProperty(dpy, c->win, netatom[NetWMBypassCompositor]);
+		c->ownbypass = 0;
 		c->isfullscreen = 0;
-		c->isfloating = c->oldstate;
-		c->bw = c->oldbw;
-		c->x = c->oldx;
-		c->y = c->oldy;
-		c->w = c->oldw;
-		c->h = c->oldh;
+		c->isfloating = c->cold->oldstate;
+		c->bw = c->cold->oldbw;
+		c->x = c->cold->oldx;
+		c->y = c->cold->oldy;
+		c->w = c->cold->oldw;
+		c->h = c->cold->oldh;
 		resizeclient(c, c->x, c->y, c->w, c->h);
 		arrange(c->mon);
 	}
@@ -1787,6 +2730,8 @@ setlayout(const Arg *arg)
 		selmon->sellt ^= 1;
 	if (arg && arg->v)
 		selmon->lt[selmon->sellt] = (Layout *)arg->v;
+	if (!selmon->lt[selmon->sellt]->arrange)
+		selmon->nstackwins = 0;
 	strncpy(selmon->ltsymbol, selmon->lt[selmon->sellt]->symbol, sizeof selmon->ltsymbol);
 	if (selmon->sel)
 		arrange(selmon);
@@ -1827,6 +2772,77 @@ setmfact(const Arg *arg)
 	arrange(selmon);
 }
 
+/* remembers the layout geometry of a client stacked below the shown one,
+ * it is only applied once the client is raised through focus() */
+void
+setpending(Client *c, int x, int y, int w, int h)
+{
+	c->ispending = 1;
+	c->pendx = x;
+	c->pendy = y;
+	c->pendw = w;
+	c->pendh = h;
+}
+
+/* sets status block i, adding empty blocks up to it; returns 1 and
+ * measures the text only if the block changed */
+int
+setstatusblock(unsigned int i, int sig, const char *text, size_t len)
+{
+	StatusBlock *b;
+
+	if (i >= statusblockscap) {
+		if (!(statusblocks = realloc(statusblocks, (i + 8) * sizeof(StatusBlock))))
+			die("realloc:");
+		memset(statusblocks + statusblockscap, 0, (i + 8 - statusblockscap) * sizeof(StatusBlock));
+		statusblockscap = i + 8;
+	}
+	for (; nstatusblocks <= i; nstatusblocks++) {
+		b = &statusblocks[nstatusblocks];
+		if (!b->text)
+			b->text = ecalloc(b->size = 16, 1);
+		b->text[0] = '\0';
+		b->sig = b->w = 0;
+	}
+	b = &statusblocks[i];
+	if (b->sig == sig && !strncmp(b->text, text, len) && !b->text[len])
+		return 0;
+	if (len + 1 > b->size) {
+		b->size = len + 16;
+		if (!(b->text = realloc(b->text, b->size)))
+			die("realloc:");
+	}
+	memcpy(b->text, text, len);
+	b->text[len] = '\0';
+	b->sig = sig;
+	b->w = TEXTW(b->text) - lrpad;
+	return 1;
+}
+
+/* remembers the status bar pid registered over ipc and watches it with a
+ * pidfd, so that clicks never have to look it up */
+void
+setstatuspid(pid_t pid)
+{
+	if (statuspidfd != -1)
+		close(statuspidfd);
+	statuspidfd = -1;
+	statuspid = pid;
+	statusregistered = pid > 0;
+#ifdef SYS_pidfd_open
+	if (pid > 0)
+		statuspidfd = syscall(SYS_pidfd_open, pid, 0);
+#endif
+}
+
+void
+settags(Client *c, unsigned int newtags)
+{
+	tagcount(c, -1);
+	c->tags = newtags;
+	tagcount(c, +1);
+}
+
 void
 setup(void)
 {
@@ -1834,6 +2850,7 @@ setup(void)
 	XSetWindowAttributes wa;
 	Atom utf8string;
 	struct sigaction sa;
+	sigset_t sm, osm;
 
 	/* do not transform children into zombies when they terminate */
 	sigemptyset(&sa.sa_mask);
@@ -1844,6 +2861,9 @@ setup(void)
 	/* clean up any zombies (inherited from .xinitrc etc) immediately */
 	signal(SIGHUP, sighup);
 	signal(SIGTERM, sigterm);
+#ifdef TIMELINE
+	signal(SIGUSR1, sigusr1);
+#endif /* TIMELINE */
 
 	while (waitpid(-1, NULL, WNOHANG) > 0);
 
@@ -1857,13 +2877,36 @@ setup(void)
 		die("no fonts could be loaded.");
 	lrpad = drw->fonts->h;
 	bh = drw->fonts->h + 2;
+#ifdef XRANDR
+	{
+		int errbase, major, minor;
+
+		if (XRRQueryExtension(dpy, &rrevbase, &errbase)
+		&& XRRQueryVersion(dpy, &major, &minor)) {
+			rrmonitors = major > 1 || (major == 1 && minor >= 5);
+			XRRSelectInput(dpy, root, RRScreenChangeNotifyMask);
+		} else
+			rrevbase = -1;
+	}
+#endif /* XRANDR */
+#ifdef XSYNC
+	{
+		int errbase, major, minor;
+
+		if (!XSyncQueryExtension(dpy, &syncevbase, &errbase)
+		|| !XSyncInitialize(dpy, &major, &minor))
+			syncevbase = -1;
+	}
+#endif /* XSYNC */
 	updategeom();
+	updaterefreshrate();
 	/* init atoms */
 	utf8string = XInternAtom(dpy, "UTF8_STRING", False);
 	wmatom[WMProtocols] = XInternAtom(dpy, "WM_PROTOCOLS", False);
 	wmatom[WMDelete] = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
 	wmatom[WMState] = XInternAtom(dpy, "WM_STATE", False);
 	wmatom[WMTakeFocus] = XInternAtom(dpy, "WM_TAKE_FOCUS", False);
+	claimedatom = XInternAtom(dpy, "_DWM_STPOOL_CLAIMED", False);
 	netatom[NetActiveWindow] = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
 	netatom[NetSupported] = XInternAtom(dpy, "_NET_SUPPORTED", False);
 	netatom[NetWMName] = XInternAtom(dpy, "_NET_WM_NAME", False);
@@ -1873,6 +2916,11 @@ setup(void)
 	netatom[NetWMWindowType] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
 	netatom[NetWMWindowTypeDialog] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
 	netatom[NetClientList] = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+	netatom[NetWMBypassCompositor] = XInternAtom(dpy, "_NET_WM_BYPASS_COMPOSITOR", False);
+#ifdef XSYNC
+	netatom[NetWMSyncRequest] = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST", False);
+	netatom[NetWMSyncRequestCounter] = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST_COUNTER", False);
+#endif /* XSYNC */
 	/* init cursors */
 	cursor[CurNormal] = drw_cur_create(drw, XC_left_ptr);
 	cursor[CurResize] = drw_cur_create(drw, XC_sizing);
@@ -1898,28 +2946,64 @@ setup(void)
 	XDeleteProperty(dpy, root, netatom[NetClientList]);
 	/* select events */
 	wa.cursor = cursor[CurNormal]->cursor;
-	wa.event_mask = SubstructureRedirectMask|SubstructureNotifyMask
-		|ButtonPressMask|PointerMotionMask|EnterWindowMask
-		|LeaveWindowMask|StructureNotifyMask|PropertyChangeMask;
+	wa.event_mask = ROOTMASK;
 	XChangeWindowAttributes(dpy, root, CWEventMask|CWCursor, &wa);
 	XSelectInput(dpy, root, wa.event_mask);
+	updatenumlockmask();
 	grabkeys();
 	focus(NULL);
+	ipcinit();
+	/* children get their own session (process group where POSIX_SPAWN_SETSID
+	 * is not declared), default signals and no X connection */
+	posix_spawnattr_init(&spawnattr);
+	sigemptyset(&sm);
+	posix_spawnattr_setsigmask(&spawnattr, &sm);
+	sigaddset(&sm, SIGCHLD);
+	posix_spawnattr_setsigdefault(&spawnattr, &sm);
+#ifdef POSIX_SPAWN_SETSID
+	posix_spawnattr_setflags(&spawnattr, POSIX_SPAWN_SETSID|POSIX_SPAWN_SETSIGMASK|POSIX_SPAWN_SETSIGDEF);
+#else
+	posix_spawnattr_setpgroup(&spawnattr, 0);
+	posix_spawnattr_setflags(&spawnattr, POSIX_SPAWN_SETPGROUP|POSIX_SPAWN_SETSIGMASK|POSIX_SPAWN_SETSIGDEF);
+#endif /* POSIX_SPAWN_SETSID */
+	posix_spawn_file_actions_init(&spawnactions);
+	posix_spawn_file_actions_addclose(&spawnactions, ConnectionNumber(dpy));
+	/* worker for blocking lookups, with all signals left to the main thread */
+	if (pipe(workerpipe) == -1)
+		die("pipe:");
+	for (i = 0; i < 2; i++)
+		fcntl(workerpipe[i], F_SETFD, FD_CLOEXEC);
+	fcntl(workerpipe[0], F_SETFL, O_NONBLOCK);
+	sigfillset(&sm);
+	pthread_sigmask(SIG_SETMASK, &sm, &osm);
+	if ((i = pthread_create(&workerthread, NULL, worker, NULL)))
+		die("dwm: cannot create worker thread: %s", strerror(i));
+	pthread_sigmask(SIG_SETMASK, &osm, NULL);
 }
 
 void
 seturgent(Client *c, int urg)
 {
-	XWMHints *wmh;
+	seturgentflag(c, urg);
+	if (!c->haswmh)
+		return;
+	c->wmh.flags = urg ? (c->wmh.flags | XUrgencyHint) : (c->wmh.flags & ~XUrgencyHint);
+	XSetWMHints(dpy, c->win, &c->wmh);
+}
 
-	c->isurgent = urg;
-	if (!(wmh = XGetWMHints(dpy, c->win)))
+/* updates the urgency flag and the per-tag urgent counts, unlike seturgent()
+ * it leaves the client's WM_HINTS alone */
+void
+seturgentflag(Client *c, int urg)
+{
+	if (c->isurgent == urg)
 		return;
-	wmh->flags = urg ? (wmh->flags | XUrgencyHint) : (wmh->flags & ~XUrgencyHint);
-	XSetWMHints(dpy, c->win, wmh);
-	XFree(wmh);
+	tagcount(c, -1);
+	c->isurgent = urg;
+	tagcount(c, +1);
 }
 
+/* only clients entering or leaving visibility are moved */
 void
 showhide(Client *c)
 {
@@ -1927,51 +3011,104 @@ showhide(Client *c)
 		return;
 	if (ISVISIBLE(c)) {
 		/* show clients top down */
-		XMoveWindow(dpy, c->win, c->x, c->y);
+		if (c->ishidden) {
+			XMoveWindow(dpy, c->win, c->x, c->y);
+			c->ishidden = 0;
+		}
+		if (c->isiconic) {
+			XMapWindow(dpy, c->win);
+			setclientstate(c, NormalState);
+			c->isiconic = 0;
+		}
 		if ((!c->mon->lt[c->mon->sellt]->arrange || c->isfloating) && !c->isfullscreen)
 			resize(c, c->x, c->y, c->w, c->h, 0);
 		showhide(c->snext);
 	} else {
 		/* hide clients bottom up */
 		showhide(c->snext);
-		XMoveWindow(dpy, c->win, WIDTH(c) * -2, c->y);
+		if (hiddenunmap && c->tags != POOLTAG) {
+			/* stops the client from drawing and the compositor from
+			 * tracking it, at the cost of a redraw when shown again;
+			 * spares are left mapped so that claiming one is instant */
+			if (!c->isiconic) {
+				/* the UnmapNotify for the client window and the one
+				 * for root's substructure would read as the client
+				 * withdrawing, so neither is selected while unmapping */
+				XGrabServer(dpy);
+				XSelectInput(dpy, root, ROOTMASK & ~SubstructureNotifyMask);
+				XSelectInput(dpy, c->win, CLIENTMASK & ~StructureNotifyMask);
+				XUnmapWindow(dpy, c->win);
+				XSelectInput(dpy, root, ROOTMASK);
+				XSelectInput(dpy, c->win, CLIENTMASK);
+				XUngrabServer(dpy);
+				setclientstate(c, IconicState);
+				c->isiconic = 1;
+			}
+		} else if (!c->ishidden) {
+			XMoveWindow(dpy, c->win, WIDTH(c) * -2, c->y);
+			c->ishidden = 1;
+		}
 	}
 }
 
+/* a stacking layout only shows its topmost tiled client, configure that one */
+void
+showpending(Monitor *m)
+{
+	Client *c;
+
+	for (c = m->stack; c && (!c->ispending || c->isfloating || !ISVISIBLE(c)); c = c->snext);
+	if (c)
+		applypending(c);
+}
+
 void
 sigstatusbar(const Arg *arg)
 {
 	union sigval sv;
+	StatusJob *j;
 
 	if (!statussig)
 		return;
-	sv.sival_int = arg->i;
-	if ((statuspid = getstatusbarpid()) <= 0)
+	if (statuspid > 0 && statusregistered) {
+		sv.sival_int = arg->i;
+		if (sigqueue(statuspid, SIGRTMIN+statussig, sv) == -1 && errno == ESRCH)
+			setstatuspid(-1);
 		return;
-
-	sigqueue(statuspid, SIGRTMIN+statussig, sv);
+	}
+	/* an unregistered bar has to be looked up in /proc first */
+	j = ecalloc(1, sizeof(StatusJob));
+	j->job.run = statusbarlookup;
+	j->job.done = statusbarfound;
+	j->pid = statuspid;
+	j->sig = statussig;
+	j->button = arg->i;
+	queuejob(&j->job);
 }
 
+/* posix_spawn shares dwm's address space until the exec instead of copying
+ * its page tables, the session, signal and fd setup is prepared in setup() */
 void
 spawn(const Arg *arg)
 {
-	struct sigaction sa;
+	char **argv = (char **)arg->v;
+	long long t;
+	pid_t pid;
+	int e;
 
+	if (replayfp)
+		return;
 	if (arg->v == dmenucmd)
 		dmenumon[0] = '0' + selmon->num;
-	if (fork() == 0) {
-		if (dpy)
-			close(ConnectionNumber(dpy));
-		setsid();
-
-		sigemptyset(&sa.sa_mask);
-		sa.sa_flags = 0;
-		sa.sa_handler = SIG_DFL;
-		sigaction(SIGCHLD, &sa, NULL);
-
-		execvp(((char **)arg->v)[0], (char **)arg->v);
-		die("dwm: execvp '%s' failed:", ((char **)arg->v)[0]);
+	t = nowus();
+	if ((e = posix_spawnp(&pid, argv[0], &spawnactions, &spawnattr, argv, environ))) {
+		fprintf(stderr, "dwm: spawn '%s' failed: %s\n", argv[0], strerror(e));
+		return;
 	}
+	timing(&spawntime, nowus() - t);
+	launches[nlaunches].pid = pid;
+	launches[nlaunches].at = t / 1000;
+	nlaunches = (nlaunches + 1) % LENGTH(launches);
 }
 
 void
@@ -1988,16 +3125,243 @@ sigterm(int unused)
 	quit(&a);
 }
 
+/* a terminal from the pool when one is ready, else a cold start of arg */
+void
+spawnterm(const Arg *arg)
+{
+	Client *c;
+
+	if (!(c = claimspare())) {
+		spawn(arg);
+		fillspares();
+		return;
+	}
+	focus(c);
+	arrange(selmon);
+}
+
+/* marks in keep the longest strictly increasing run of known positions in
+ * pos (-1 means unknown), i.e. the windows restack may leave in place */
+void
+stackkeep(const int *pos, int *keep, unsigned int n)
+{
+	static int *tail;
+	static unsigned int size;
+	int *prev, len = 0, lo, hi, mid, k;
+	unsigned int i;
+
+	if (n >= size) {
+		size = n + 32;
+		if (!(tail = realloc(tail, 2 * size * sizeof(int))))
+			die("realloc:");
+	}
+	prev = tail + size;
+	for (i = 0; i < n; i++) {
+		keep[i] = 0;
+		if (pos[i] < 0)
+			continue;
+		for (lo = 0, hi = len; lo < hi;) {
+			mid = (lo + hi) / 2;
+			if (pos[tail[mid]] < pos[i])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		prev[i] = lo ? tail[lo - 1] : -1;
+		tail[lo] = i;
+		if (lo == len)
+			len++;
+	}
+	for (k = len ? tail[len - 1] : -1; k >= 0; k = prev[k])
+		keep[k] = 1;
+}
+
+void
+statusbarfound(Job *job)
+{
+	StatusJob *j = (StatusJob *)job;
+	union sigval sv;
+
+	if (statusregistered) /* the bar registered meanwhile */
+		j->pid = statuspid;
+	else
+		statuspid = j->pid;
+	if (j->pid <= 0)
+		return;
+	sv.sival_int = j->button;
+	sigqueue(j->pid, SIGRTMIN+j->sig, sv);
+}
+
+void
+statusbarlookup(Job *job)
+{
+	StatusJob *j = (StatusJob *)job;
+
+	j->pid = getstatusbarpid(j->pid);
+}
+
+/* worker side of queueswallow */
+void
+swallowlookup(Job *job)
+{
+	SwallowJob *j = (SwallowJob *)job;
+	unsigned int i;
+
+	if (!(j->pid = winpid(j->win)))
+		return;
+	for (i = 0; i < j->nterms && j->term == -1; i++)
+		if (isdescprocess(j->terms[i].pid, j->pid))
+			j->term = i;
+}
+
+void
+swallowresult(Job *job)
+{
+	SwallowJob *j = (SwallowJob *)job;
+	Client *c, *t;
+
+	if (!(c = poolget(j->client))) /* gone meanwhile */
+		return;
+	c->pid = j->pid;
+	launched(c->pid, j->at);
+	if (j->term != -1 && (t = poolget(j->terms[j->term].client)) && t != c
+	&& t->isterminal && !SWALLOWED(t)) {
+		swallow(t, c);
+		focus(NULL);
+	}
+}
+
+#ifdef XSYNC
+/* gives up on clients that did not paint their last size in time, returns
+ * the earliest remaining deadline or 0 if nothing is outstanding */
+long long
+synccheck(void)
+{
+	Monitor *m;
+	Client *c;
+	long long now, next = 0;
+
+	if (!nsyncwait)
+		return 0;
+	now = nowms();
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next) {
+			if (!c->cold->syncwait)
+				continue;
+			if (c->cold->syncat <= now)
+				syncdone(c);
+			else if (!next || c->cold->syncat < next)
+				next = c->cold->syncat;
+		}
+	return next;
+}
+
+void
+syncdone(Client *c)
+{
+	ASYNCEND("sync", c->win);
+	c->cold->syncwait = 0;
+	nsyncwait--;
+	if (c->cold->syncdirty) {
+		c->cold->syncdirty = 0;
+		/* showhide parked the window off screen meanwhile, the held
+		 * position would bring it back; showhide restores it on view */
+		if (c->ishidden)
+			XResizeWindow(dpy, c->win, c->w, c->h);
+		else
+			moveresize(c, 1);
+	}
+}
+
+/* the mouse loops only see core events, handle alarms in between */
+void
+syncdrain(void)
+{
+	XEvent ev;
+
+	if (syncevbase == -1)
+		return;
+	while (XCheckTypedEvent(dpy, syncevbase + XSyncAlarmNotify, &ev))
+		syncnotify(&ev);
+	synccheck();
+}
+
+void
+syncnotify(XEvent *e)
+{
+	XSyncAlarmNotifyEvent *ev = (XSyncAlarmNotifyEvent *)e;
+	Monitor *m;
+	Client *c;
+
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			if (c->cold->syncalarm == ev->alarm) {
+				if (c->cold->syncwait)
+					syncdone(c);
+				return;
+			}
+}
+
+/* asks the client to bump its counter once it has painted the next size,
+ * sent right before the ConfigureNotify it refers to */
+void
+syncrequest(Client *c)
+{
+	XEvent ev;
+	XSyncValue one;
+	XSyncAlarmAttributes attr;
+	int overflow;
+
+	XSyncIntToValue(&one, 1);
+	XSyncValueAdd(&c->cold->syncvalue, c->cold->syncvalue, one, &overflow);
+	ev.type = ClientMessage;
+	ev.xclient.window = c->win;
+	ev.xclient.message_type = wmatom[WMProtocols];
+	ev.xclient.format = 32;
+	ev.xclient.data.l[0] = netatom[NetWMSyncRequest];
+	ev.xclient.data.l[1] = CurrentTime;
+	ev.xclient.data.l[2] = XSyncValueLow32(c->cold->syncvalue);
+	ev.xclient.data.l[3] = XSyncValueHigh32(c->cold->syncvalue);
+	ev.xclient.data.l[4] = 0;
+	XSendEvent(dpy, c->win, False, NoEventMask, &ev);
+	attr.trigger.wait_value = c->cold->syncvalue;
+	XSyncChangeAlarm(dpy, c->cold->syncalarm, XSyncCAValue, &attr);
+	c->cold->syncwait = 1;
+	c->cold->syncat = nowms() + synctimeout;
+	nsyncwait++;
+	ASYNCBEGIN("sync", c->win);
+}
+#endif /* XSYNC */
+
 void
 tag(const Arg *arg)
 {
 	if (selmon->sel && arg->ui & TAGMASK) {
-		selmon->sel->tags = arg->ui & TAGMASK;
+		settags(selmon->sel, arg->ui & TAGMASK);
 		focus(NULL);
 		arrange(selmon);
 	}
 }
 
+/* adds d to the per-tag occupant and urgency counts of c's monitor */
+void
+tagcount(Client *c, int d)
+{
+	unsigned int i;
+	Monitor *m = c->mon;
+
+	for (i = 0; i < LENGTH(tags); i++) {
+		if (!(c->tags & 1 << i))
+			continue;
+		if (c->tags != TAGMASK) /* clients on all tags don't occupy any */
+			m->ntagocc[i] += d;
+		if (c->isurgent)
+			m->ntagurg[i] += d;
+		m->occ = m->ntagocc[i] ? m->occ | 1 << i : m->occ & ~(1 << i);
+		m->urg = m->ntagurg[i] ? m->urg | 1 << i : m->urg & ~(1 << i);
+	}
+}
+
 void
 tagmon(const Arg *arg)
 {
@@ -2006,6 +3370,15 @@ tagmon(const Arg *arg)
 	sendmon(selmon->sel, dirtomon(arg->i));
 }
 
+void
+timing(Timing *t, long long v)
+{
+	t->n++;
+	t->last = v;
+	t->total += v;
+	t->max = MAX(t->max, v);
+}
+
 void
 togglebar(const Arg *arg)
 {
@@ -2022,13 +3395,47 @@ togglefloating(const Arg *arg)
 		return;
 	if (selmon->sel->isfullscreen) /* no support for fullscreen windows */
 		return;
-	selmon->sel->isfloating = !selmon->sel->isfloating || selmon->sel->isfixed;
+	selmon->sel->isfloating = !selmon->sel->isfloating || selmon->sel->cold->isfixed;
 	if (selmon->sel->isfloating)
 		resize(selmon->sel, selmon->sel->x, selmon->sel->y,
 			selmon->sel->w, selmon->sel->h, 0);
 	arrange(selmon);
 }
 
+/* shows or hides the floating scratchpad terminal; the first call claims a
+ * spare for it, or asks for the next one if none is ready yet */
+void
+togglescratch(const Arg *arg)
+{
+	Client *c = NULL;
+	Monitor *m;
+
+	for (m = mons; m && !c; m = m->next)
+		for (c = m->clients; c && !c->isscratch; c = c->next);
+	if (c && c->mon == selmon && ISVISIBLE(c)) {
+		settags(c, SCRATCHTAG);
+		showhide(selmon->stack);
+		focus(NULL);
+		return;
+	}
+	if (c)
+		pullclient(c);
+	else if ((c = claimspare())) {
+		c->isscratch = c->isfloating = 1;
+		c->w = selmon->ww * 9 / 10 - 2 * c->bw;
+		c->h = selmon->wh / 2 - 2 * c->bw;
+		c->x = selmon->wx + (selmon->ww - WIDTH(c)) / 2;
+		c->y = selmon->wy + (selmon->wh - HEIGHT(c)) / 2;
+	} else {
+		scratchwanted = 1;
+		fillspares();
+		return;
+	}
+	showhide(selmon->stack);
+	focus(c);
+	restack(selmon);
+}
+
 void
 toggletag(const Arg *arg)
 {
@@ -2038,7 +3445,7 @@ toggletag(const Arg *arg)
 		return;
 	newtags = selmon->sel->tags ^ (arg->ui & TAGMASK);
 	if (newtags) {
-		selmon->sel->tags = newtags;
+		settags(selmon->sel, newtags);
 		focus(NULL);
 		arrange(selmon);
 	}
@@ -2069,21 +3476,67 @@ unfocus(Client *c, int setfocus)
 	}
 }
 
+#ifdef XINERAMA
+/* the distinct monitor geometries, from the RandR 1.5 monitor list when the
+ * server has one and Xinerama otherwise, NULL if neither is active */
+static XineramaScreenInfo *
+uniquescreens(int *n)
+{
+	XineramaScreenInfo *info = NULL, *unique;
+	int i, j, nn = 0;
+
+#ifdef XRANDR
+	XRRMonitorInfo *mi;
+
+	if (rrmonitors && (mi = XRRGetMonitors(dpy, root, True, &nn))) {
+		if (nn > 0) {
+			info = ecalloc(nn, sizeof(XineramaScreenInfo));
+			for (i = 0; i < nn; i++) {
+				info[i].screen_number = i;
+				info[i].x_org = mi[i].x;
+				info[i].y_org = mi[i].y;
+				info[i].width = mi[i].width;
+				info[i].height = mi[i].height;
+			}
+		}
+		XRRFreeMonitors(mi);
+	}
+#endif /* XRANDR */
+	if (!info && XineramaIsActive(dpy)) {
+		unique = XineramaQueryScreens(dpy, &nn);
+		info = ecalloc(MAX(nn, 1), sizeof(XineramaScreenInfo));
+		memcpy(info, unique, nn * sizeof(XineramaScreenInfo));
+		XFree(unique);
+	}
+	if (!info)
+		return NULL;
+	/* only consider unique geometries as separate screens */
+	unique = ecalloc(MAX(nn, 1), sizeof(XineramaScreenInfo));
+	for (i = 0, j = 0; i < nn; i++)
+		if (isuniquegeom(unique, j, &info[i]))
+			memcpy(&unique[j++], &info[i], sizeof(XineramaScreenInfo));
+	free(info);
+	*n = j;
+	return unique;
+}
+#endif /* XINERAMA */
+
 void
 unmanage(Client *c, int destroyed)
 {
 	Monitor *m = c->mon;
 	XWindowChanges wc;
+	unsigned int i;
 
-	if (c->swallowing) {
+	if (SWALLOWED(c)) {
 		unswallow(c);
 		return;
 	}
 
 	Client *s = swallowingclient(c->win);
 	if (s) {
-		free(s->swallowing);
-		s->swallowing = NULL;
+		freeclient(SWALLOWED(s));
+		s->swallowing = poolref(NULL);
 		arrange(m);
 		focus(NULL);
 		return;
@@ -2091,19 +3544,31 @@ unmanage(Client *c, int destroyed)
 
 	detach(c);
 	detachstack(c);
+#ifdef XSYNC
+	updatesync(c, 0);
+#endif /* XSYNC */
+	/* the window id may be reused, forget its remembered stacking slot */
+	for (i = 0; i < m->nstackwins; i++)
+		if (m->stackwins[i] == c->win)
+			m->stackwins[i] = None;
 	if (!destroyed) {
-		wc.border_width = c->oldbw;
+		wc.border_width = c->cold->oldbw;
 		XGrabServer(dpy); /* avoid race conditions */
 		XSetErrorHandler(xerrordummy);
 		XSelectInput(dpy, c->win, NoEventMask);
 		XConfigureWindow(dpy, c->win, CWBorderWidth, &wc); /* restore border */
 		XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
-		setclientstate(c, WithdrawnState);
+		/* iconic windows left behind on exit must stay findable by scan */
+		setclientstate(c, c->isiconic && !running ? IconicState : WithdrawnState);
+		SPANBEGIN("XSync");
 		XSync(dpy, False);
+		SPANEND("XSync");
 		XSetErrorHandler(xerror);
 		XUngrabServer(dpy);
 	}
-	free(c);
+	if (c->tags == POOLTAG && running)
+		fillspares(); /* a spare exited */
+	freeclient(c);
 
 	if (!s) {
 		arrange(m);
@@ -2119,9 +3584,9 @@ unmapnotify(XEvent *e)
 	XUnmapEvent *ev = &e->xunmap;
 
 	if ((c = wintoclient(ev->window))) {
-		if (ev->send_event)
+		if (ev->send_event && !c->isiconic)
 			setclientstate(c, WithdrawnState);
-		else
+		else /* real, or the synthetic unmap an iconic client withdraws with */
 			unmanage(c, 0);
 	}
 }
@@ -2161,18 +3626,11 @@ updatebarpos(Monitor *m)
 		m->by = -bh;
 }
 
+/* _NET_CLIENT_LIST is rewritten once at the end of the event batch */
 void
 updateclientlist()
 {
-	Client *c;
-	Monitor *m;
-
-	XDeleteProperty(dpy, root, netatom[NetClientList]);
-	for (m = mons; m; m = m->next)
-		for (c = m->clients; c; c = c->next)
-			XChangeProperty(dpy, root, netatom[NetClientList],
-				XA_WINDOW, 32, PropModeAppend,
-				(unsigned char *) &(c->win), 1);
+	clientlistdirty = 1;
 }
 
 int
@@ -2181,22 +3639,15 @@ updategeom(void)
 	int dirty = 0;
 
 #ifdef XINERAMA
-	if (XineramaIsActive(dpy)) {
-		int i, j, n, nn;
+	int nn;
+	XineramaScreenInfo *unique;
+
+	if ((unique = uniquescreens(&nn))) {
+		int i, n;
 		Client *c;
 		Monitor *m;
-		XineramaScreenInfo *info = XineramaQueryScreens(dpy, &nn);
-		XineramaScreenInfo *unique = NULL;
 
 		for (n = 0, m = mons; m; m = m->next, n++);
-		/* only consider unique geometries as separate screens */
-		unique = ecalloc(nn, sizeof(XineramaScreenInfo));
-		for (i = 0, j = 0; i < nn; i++)
-			if (isuniquegeom(unique, j, &info[i]))
-				memcpy(&unique[j++], &info[i], sizeof(XineramaScreenInfo));
-		XFree(info);
-		nn = j;
-
 		/* new monitors if nn > n */
 		for (i = n; i < nn; i++) {
 			for (m = mons; m && m->next; m = m->next);
@@ -2223,7 +3674,7 @@ updategeom(void)
 			for (m = mons; m && m->next; m = m->next);
 			while ((c = m->clients)) {
 				dirty = 1;
-				m->clients = c->next;
+				detach(c);
 				detachstack(c);
 				c->mon = mons;
 				attach(c);
@@ -2269,93 +3720,197 @@ updatenumlockmask(void)
 	XFreeModifiermap(modmap);
 }
 
+void
+updateprotocols(Client *c)
+{
+	int i, n, r;
+	Atom *protocols;
+#ifdef XSYNC
+	int cansync = 0;
+#endif /* XSYNC */
+
+	c->protos = 0;
+	SPANBEGIN("XGetWMProtocols");
+	r = XGetWMProtocols(dpy, c->win, &protocols, &n);
+	SPANEND("XGetWMProtocols");
+	if (r) {
+		for (i = 0; i < n; i++) {
+			if (protocols[i] == wmatom[WMDelete])
+				c->protos |= 1 << WMDelete;
+			else if (protocols[i] == wmatom[WMTakeFocus])
+				c->protos |= 1 << WMTakeFocus;
+#ifdef XSYNC
+			else if (protocols[i] == netatom[NetWMSyncRequest])
+				cansync = 1;
+#endif /* XSYNC */
+		}
+		XFree(protocols);
+	}
+#ifdef XSYNC
+	updatesync(c, cansync);
+#endif /* XSYNC */
+}
+
+/* pace interactive moves and resizes to the fastest active CRTC */
+void
+updaterefreshrate(void)
+{
+	int rate = 0;
+#ifdef XRANDR
+	int i, j, evbase, errbase;
+	XRRScreenResources *res;
+	XRRCrtcInfo *ci;
+	XRRModeInfo *mi;
+
+	if (XRRQueryExtension(dpy, &evbase, &errbase)
+	&& (res = XRRGetScreenResourcesCurrent(dpy, root))) {
+		for (i = 0; i < res->ncrtc; i++) {
+			if (!(ci = XRRGetCrtcInfo(dpy, res, res->crtcs[i])))
+				continue;
+			for (j = 0; ci->mode != None && j < res->nmode; j++) {
+				mi = &res->modes[j];
+				if (mi->id == ci->mode && mi->hTotal && mi->vTotal)
+					rate = MAX(rate, (int)((double)mi->dotClock / ((double)mi->hTotal * mi->vTotal) + 0.5));
+			}
+			XRRFreeCrtcInfo(ci);
+		}
+		XRRFreeScreenResources(res);
+	}
+#endif /* XRANDR */
+	if (rate <= 0)
+		rate = refreshrate;
+	motioninterval = 1000 / rate;
+}
+
 void
 updatesizehints(Client *c)
 {
 	long msize;
 	XSizeHints size;
 
+	SPANBEGIN("XGetWMNormalHints");
 	if (!XGetWMNormalHints(dpy, c->win, &size, &msize))
 		/* size is uninitialized, ensure that size.flags aren't used */
 		size.flags = PSize;
+	SPANEND("XGetWMNormalHints");
 	if (size.flags & PBaseSize) {
-		c->basew = size.base_width;
-		c->baseh = size.base_height;
+		c->cold->basew = size.base_width;
+		c->cold->baseh = size.base_height;
 	} else if (size.flags & PMinSize) {
-		c->basew = size.min_width;
-		c->baseh = size.min_height;
+		c->cold->basew = size.min_width;
+		c->cold->baseh = size.min_height;
 	} else
-		c->basew = c->baseh = 0;
+		c->cold->basew = c->cold->baseh = 0;
 	if (size.flags & PResizeInc) {
-		c->incw = size.width_inc;
-		c->inch = size.height_inc;
+		c->cold->incw = size.width_inc;
+		c->cold->inch = size.height_inc;
 	} else
-		c->incw = c->inch = 0;
+		c->cold->incw = c->cold->inch = 0;
 	if (size.flags & PMaxSize) {
-		c->maxw = size.max_width;
-		c->maxh = size.max_height;
+		c->cold->maxw = size.max_width;
+		c->cold->maxh = size.max_height;
 	} else
-		c->maxw = c->maxh = 0;
+		c->cold->maxw = c->cold->maxh = 0;
 	if (size.flags & PMinSize) {
-		c->minw = size.min_width;
-		c->minh = size.min_height;
+		c->cold->minw = size.min_width;
+		c->cold->minh = size.min_height;
 	} else if (size.flags & PBaseSize) {
-		c->minw = size.base_width;
-		c->minh = size.base_height;
+		c->cold->minw = size.base_width;
+		c->cold->minh = size.base_height;
 	} else
-		c->minw = c->minh = 0;
+		c->cold->minw = c->cold->minh = 0;
 	if (size.flags & PAspect) {
-		c->mina = (float)size.min_aspect.y / size.min_aspect.x;
-		c->maxa = (float)size.max_aspect.x / size.max_aspect.y;
+		c->cold->mina = (float)size.min_aspect.y / size.min_aspect.x;
+		c->cold->maxa = (float)size.max_aspect.x / size.max_aspect.y;
 	} else
-		c->maxa = c->mina = 0.0;
-	c->isfixed = (c->maxw && c->maxh && c->maxw == c->minw && c->maxh == c->minh);
-	c->hintsvalid = 1;
+		c->cold->maxa = c->cold->mina = 0.0;
+	c->cold->isfixed = (c->cold->maxw && c->cold->maxh && c->cold->maxw == c->cold->minw && c->cold->maxh == c->cold->minh);
+	c->cold->hintsvalid = 1;
 }
 
 void
 updatestatus(void)
 {
-	if (!gettextprop(root, XA_WM_NAME, stext, sizeof(stext))) {
+	unsigned int n = 0, nchanged = 0, last = 0, oldn = nstatusblocks;
+	char *text, *s;
+	int sig = 0;
+
+	if (!gettextprop(root, XA_WM_NAME, stext, sizeof(stext)))
 		strcpy(stext, "dwm-"VERSION);
-		statusw = TEXTW(stext) - lrpad + 2;
-	} else {
-		char *text, *s, ch;
-
-		statusw  = 0;
-		for (text = s = stext; *s; s++) {
-			if ((unsigned char)(*s) < ' ') {
-				ch = *s;
-				*s = '\0';
-				statusw += TEXTW(text) - lrpad;
-				*s = ch;
-				text = s + 1;
-			}
+	for (text = s = stext; ; s++) {
+		if (*s && (unsigned char)(*s) >= ' ')
+			continue;
+		if (setstatusblock(n, sig, text, s - text)) {
+			nchanged++;
+			last = n;
 		}
-		statusw += TEXTW(text) - lrpad + 2;
+		n++;
+		if (!*s)
+			break;
+		sig = (unsigned char)*s;
+		text = s + 1;
+	}
+	nstatusblocks = n;
+	redrawstatus(nchanged + (n != oldn) * 2, last);
+}
 
+#ifdef XSYNC
+/* arms an alarm on the client's _NET_WM_SYNC_REQUEST_COUNTER, or drops it */
+void
+updatesync(Client *c, int enable)
+{
+	int di;
+	unsigned long dl;
+	unsigned char *p = NULL;
+	Atom da;
+	XSyncAlarmAttributes attr;
+
+	c->cold->synccounter = None; /* flush held back geometry without a new request */
+	if (c->cold->syncwait)
+		syncdone(c);
+	if (c->cold->syncalarm != None)
+		XSyncDestroyAlarm(dpy, c->cold->syncalarm);
+	c->cold->syncalarm = None;
+	if (!enable || syncevbase == -1)
+		return;
+	if (XGetWindowProperty(dpy, c->win, netatom[NetWMSyncRequestCounter], 0L, 1L,
+		False, XA_CARDINAL, &da, &di, &dl, &dl, &p) == Success && p) {
+		c->cold->synccounter = *(long *)p;
+		XFree(p);
 	}
-	drawbar(selmon);
+	if (c->cold->synccounter == None || !XSyncQueryCounter(dpy, c->cold->synccounter, &c->cold->syncvalue)) {
+		c->cold->synccounter = None;
+		return;
+	}
+	attr.trigger.counter = c->cold->synccounter;
+	attr.trigger.value_type = XSyncAbsolute;
+	attr.trigger.wait_value = c->cold->syncvalue;
+	attr.trigger.test_type = XSyncPositiveComparison;
+	XSyncIntToValue(&attr.delta, 0);
+	attr.events = True;
+	c->cold->syncalarm = XSyncCreateAlarm(dpy, XSyncCACounter|XSyncCAValueType|XSyncCAValue
+		|XSyncCATestType|XSyncCADelta|XSyncCAEvents, &attr);
 }
+#endif /* XSYNC */
 
 void
 updatetitle(Client *c)
 {
-	if (!gettextprop(c->win, netatom[NetWMName], c->name, sizeof c->name))
-		gettextprop(c->win, XA_WM_NAME, c->name, sizeof c->name);
-	if (c->name[0] == '\0') /* hack to mark broken clients */
-		strcpy(c->name, broken);
+	if (!gettextprop(c->win, netatom[NetWMName], c->cold->name, sizeof c->cold->name))
+		gettextprop(c->win, XA_WM_NAME, c->cold->name, sizeof c->cold->name);
+	if (c->cold->name[0] == '\0') /* hack to mark broken clients */
+		strcpy(c->cold->name, broken);
 }
 
 void
 updatewindowtype(Client *c)
 {
 	Atom state = getatomprop(c, netatom[NetWMState]);
-	Atom wtype = getatomprop(c, netatom[NetWMWindowType]);
 
+	c->wtype = getatomprop(c, netatom[NetWMWindowType]);
 	if (state == netatom[NetWMFullscreen])
 		setfullscreen(c, 1);
-	if (wtype == netatom[NetWMWindowTypeDialog])
+	if (c->wtype == netatom[NetWMWindowTypeDialog])
 		c->isfloating = 1;
 }
 
@@ -2364,18 +3919,25 @@ updatewmhints(Client *c)
 {
 	XWMHints *wmh;
 
-	if ((wmh = XGetWMHints(dpy, c->win))) {
-		if (c == selmon->sel && wmh->flags & XUrgencyHint) {
-			wmh->flags &= ~XUrgencyHint;
-			XSetWMHints(dpy, c->win, wmh);
-		} else
-			c->isurgent = (wmh->flags & XUrgencyHint) ? 1 : 0;
-		if (wmh->flags & InputHint)
-			c->neverfocus = !wmh->input;
-		else
-			c->neverfocus = 0;
-		XFree(wmh);
+	SPANBEGIN("XGetWMHints");
+	wmh = XGetWMHints(dpy, c->win);
+	SPANEND("XGetWMHints");
+	if (!wmh) {
+		c->haswmh = 0;
+		return;
 	}
+	c->wmh = *wmh;
+	c->haswmh = 1;
+	XFree(wmh);
+	if (c == selmon->sel && c->wmh.flags & XUrgencyHint) {
+		c->wmh.flags &= ~XUrgencyHint;
+		XSetWMHints(dpy, c->win, &c->wmh);
+	} else
+		seturgentflag(c, (c->wmh.flags & XUrgencyHint) ? 1 : 0);
+	if (c->wmh.flags & InputHint)
+		c->neverfocus = !c->wmh.input;
+	else
+		c->neverfocus = 0;
 }
 
 void
@@ -2485,25 +4047,6 @@ isdescprocess(pid_t p, pid_t c)
 	return (int)c;
 }
 
-Client *
-termforwin(const Client *w)
-{
-	Client *c;
-	Monitor *m;
-
-	if (!w->pid || w->isterminal)
-		return NULL;
-
-	for (m = mons; m; m = m->next) {
-		for (c = m->clients; c; c = c->next) {
-			if (c->isterminal && !c->swallowing && c->pid && isdescprocess(c->pid, w->pid))
-				return c;
-		}
-	}
-
-	return NULL;
-}
-
 Client *
 swallowingclient(Window w)
 {
@@ -2512,7 +4055,7 @@ swallowingclient(Window w)
 
 	for (m = mons; m; m = m->next) {
 		for (c = m->clients; c; c = c->next) {
-			if (c->swallowing && c->swallowing->win == w)
+			if (SWALLOWED(c) && SWALLOWED(c)->win == w)
 				return c;
 		}
 	}
@@ -2550,6 +4093,65 @@ wintomon(Window w)
 	return selmon;
 }
 
+void *
+worker(void *unused)
+{
+	Job *j;
+
+	pthread_mutex_lock(&jobslock);
+	while (!workerstop) {
+		if (!(j = jobs)) {
+			pthread_cond_wait(&jobscond, &jobslock);
+			continue;
+		}
+		if (!(jobs = j->next))
+			lastjob = NULL;
+		pthread_mutex_unlock(&jobslock);
+		j->run(j);
+		while (write(workerpipe[1], &j, sizeof(j)) == -1 && errno == EINTR);
+		pthread_mutex_lock(&jobslock);
+	}
+	pthread_mutex_unlock(&jobslock);
+	return NULL;
+}
+
+/* finishes the jobs the worker has posted back */
+void
+workerdone(void)
+{
+	Job *j;
+
+	while (read(workerpipe[0], &j, sizeof(j)) == sizeof(j)) {
+		j->done(j);
+		free(j);
+	}
+}
+
+/* replaces _NET_CLIENT_LIST in a single request, so pagers and compositors
+ * never see it emptied or half built */
+void
+writeclientlist(void)
+{
+	static Window *wins;
+	static unsigned int size;
+	unsigned int n = 0;
+	Client *c;
+	Monitor *m;
+
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next) {
+			if (n == size) {
+				size = size ? size * 2 : 32;
+				if (!(wins = realloc(wins, size * sizeof(Window))))
+					die("realloc:");
+			}
+			wins[n++] = c->win;
+		}
+	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32,
+		PropModeReplace, (unsigned char *) wins, n);
+	clientlistdirty = 0;
+}
+
 /* There's no way to check accesses to destroyed windows, thus those cases are
  * ignored (especially on UnmapNotify's). Other types of errors call Xlibs
  * default error handler, which may call exit. */
@@ -2614,10 +4216,11 @@ main(int argc, char *argv[])
 {
 	if (argc == 2 && !strcmp("-v", argv[1]))
 		die("dwm-"VERSION);
-	else if (argc != 1)
-		die("usage: dwm [-v]");
+	else if (argc != 1 && (argc != 3 || strcmp("-r", argv[1])))
+		die("usage: dwm [-v] [-r trace]");
 	if (!setlocale(LC_CTYPE, "") || !XSupportsLocale())
 		fputs("warning: no locale support\n", stderr);
+	XInitThreads(); /* the worker thread queries XRes */
 	if (!(dpy = XOpenDisplay(NULL)))
 		die("dwm: cannot open display");
 	if (!(xcon = XGetXCBConnection(dpy)))
@@ -2627,11 +4230,17 @@ main(int argc, char *argv[])
 	loadxrdb();
 	setup();
 #ifdef __OpenBSD__
-	if (pledge("stdio rpath proc exec ps", NULL) == -1)
+	if (pledge("stdio rpath proc exec ps unix", NULL) == -1)
 		die("pledge");
 #endif /* __OpenBSD__ */
 	scan();
-	run();
+	if (argc == 3) {
+		replay(argv[2]);
+		restart = 0;
+	} else {
+		fillspares();
+		run();
+	}
 	cleanup();
 	if(restart) execvp(argv[0], argv);
 	XCloseDisplay(dpy);
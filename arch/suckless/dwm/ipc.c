@@ -0,0 +1,605 @@
+/* Control socket, included by dwm.c after config.h.
+ *
+ * Requests are single lines, replies are single lines of JSON:
+ *   run <function> [argument]            run an entry of ipccommands[]
+ *   get monitors|tags|layouts|clients    dump state
+ *   get stats                            spawn and launch latency counters
+ *   subscribe <event>...                 focus, title, tag, layout, monitor or all
+ *   blocks <n>                           set the number of status blocks
+ *   block <index> <signal> <text>        replace one status block
+ *   statuspid <pid>                      register the status bar for clicks
+ * Subscribed connections then receive {"event":...} lines with the current
+ * state and whenever the selected monitor's state changes. A connection that
+ * stops reading is dropped rather than stalling the window manager.
+ *
+ * The block requests let a status bar such as dwmblocks replace single
+ * blocks instead of rewriting the whole root window name; the status then
+ * has no overall length limit and only the changed block is measured.
+ */
+
+#define IPCMAXCLIENTS 16
+
+enum { IPCEvFocus = 1 << 0, IPCEvTitle = 1 << 1, IPCEvTag = 1 << 2,
+       IPCEvLayout = 1 << 3, IPCEvMonitor = 1 << 4 };
+
+typedef struct {
+	int fd;
+	unsigned int subs;  /* IPCEv* mask */
+	size_t len;
+	char buf[512];      /* incomplete request line */
+} IPCClient;
+
+static void ipcaccept(void);
+static void ipcblock(char *arg);
+static void ipcbroadcast(unsigned int ev);
+static void ipccleanup(void);
+static void ipcdrop(IPCClient *ic);
+static void ipcevent(unsigned int ev);
+static void ipcevents(void);
+static void ipcget(const char *what);
+static void ipchandle(struct pollfd *pfd);
+static void ipcinit(void);
+static void ipcjsonstr(const char *s);
+static void ipcpollfds(struct pollfd *pfd);
+static void ipcprintf(const char *fmt, ...);
+static void ipcread(IPCClient *ic);
+static void ipcrequest(IPCClient *ic, char *line);
+static void ipcreserve(size_t n);
+static void ipcrun(char *name, char *arg);
+static int ipcsend(IPCClient *ic);
+static unsigned int ipcsubscribe(char *events);
+static void ipctiming(const char *name, const Timing *t);
+static int ipcutf8(const char *s);
+
+static int ipcfd = -1;
+static IPCClient ipcclients[IPCMAXCLIENTS];
+static char *ipcout;          /* message being built */
+static size_t ipclen, ipccap;
+static struct {               /* state last reported to subscribers */
+	int mon;
+	unsigned int tags, occ, urg;
+	const Layout *lt;
+	Window win;
+	char name[256];
+} ipclast = { .mon = -1 };
+static const unsigned int ipcevorder[] = { /* order events are sent in */
+	IPCEvMonitor, IPCEvTag, IPCEvLayout, IPCEvFocus, IPCEvTitle
+};
+
+void
+ipcaccept(void)
+{
+	int fd, i;
+
+	if ((fd = accept(ipcfd, NULL, NULL)) == -1)
+		return;
+	for (i = 0; i < IPCMAXCLIENTS && ipcclients[i].fd != -1; i++);
+	if (i == IPCMAXCLIENTS) {
+		close(fd);
+		return;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	ipcclients[i].fd = fd;
+	ipcclients[i].subs = 0;
+	ipcclients[i].len = 0;
+}
+
+void
+ipcblock(char *arg)
+{
+	unsigned long i;
+	long sig;
+	char *end;
+
+	i = strtoul(arg, &end, 10);
+	if (end == arg || *end != ' ' || i >= 256) {
+		ipcprintf("{\"error\":\"bad block\"}");
+		return;
+	}
+	sig = strtol(arg = end + 1, &end, 10);
+	if (end == arg || (*end && *end != ' ') || sig < 0 || sig >= ' ') {
+		ipcprintf("{\"error\":\"bad signal\"}");
+		return;
+	}
+	if (*end)
+		end++;
+	if (setstatusblock(i, sig, end, strlen(end)))
+		redrawstatus(1, i);
+	ipcprintf("{\"ok\":true}");
+}
+
+/* sends the message in ipcout to every connection subscribed to ev */
+void
+ipcbroadcast(unsigned int ev)
+{
+	int i;
+
+	for (i = 0; i < IPCMAXCLIENTS; i++)
+		if (ipcclients[i].fd != -1 && ipcclients[i].subs & ev)
+			ipcsend(&ipcclients[i]);
+}
+
+void
+ipccleanup(void)
+{
+	int i;
+
+	for (i = 0; i < IPCMAXCLIENTS; i++)
+		if (ipcclients[i].fd != -1)
+			ipcdrop(&ipcclients[i]);
+	if (ipcfd != -1) {
+		close(ipcfd);
+		unlink(ipcsockpath);
+		ipcfd = -1;
+	}
+	free(ipcout);
+	ipcout = NULL;
+	ipccap = 0;
+}
+
+void
+ipcdrop(IPCClient *ic)
+{
+	close(ic->fd);
+	ic->fd = -1;
+}
+
+/* builds the message for event ev about the selected monitor in ipcout */
+void
+ipcevent(unsigned int ev)
+{
+	Monitor *m = selmon;
+	Client *c = m->sel;
+
+	ipclen = 0;
+	switch (ev) {
+	case IPCEvMonitor:
+		ipcprintf("{\"event\":\"monitor\",\"monitor\":%d}", m->num);
+		break;
+	case IPCEvTag:
+		ipcprintf("{\"event\":\"tag\",\"monitor\":%d,\"tags\":%u,\"occupied\":%u,\"urgent\":%u}",
+			m->num, m->tagset[m->seltags], m->occ, m->urg);
+		break;
+	case IPCEvLayout:
+		ipcprintf("{\"event\":\"layout\",\"monitor\":%d,\"symbol\":", m->num);
+		ipcjsonstr(m->ltsymbol);
+		ipcprintf("}");
+		break;
+	case IPCEvFocus:
+		ipcprintf("{\"event\":\"focus\",\"monitor\":%d,\"window\":%lu}", m->num, c ? c->win : None);
+		break;
+	case IPCEvTitle:
+		ipcprintf("{\"event\":\"title\",\"window\":%lu,\"name\":", c->win);
+		ipcjsonstr(c->cold->name);
+		ipcprintf("}");
+		break;
+	}
+}
+
+/* reports what changed on the selected monitor since the last call */
+void
+ipcevents(void)
+{
+	unsigned int subs = 0, changed = 0, tagset;
+	Monitor *m = selmon;
+	Client *c = m->sel;
+	Window win = c ? c->win : None;
+	int i;
+
+	for (i = 0; i < IPCMAXCLIENTS; i++)
+		if (ipcclients[i].fd != -1)
+			subs |= ipcclients[i].subs;
+
+	tagset = m->tagset[m->seltags];
+	if (m->num != ipclast.mon)
+		changed |= IPCEvMonitor | IPCEvTag | IPCEvLayout | IPCEvFocus;
+	if (tagset != ipclast.tags || m->occ != ipclast.occ || m->urg != ipclast.urg)
+		changed |= IPCEvTag;
+	if (m->lt[m->sellt] != ipclast.lt)
+		changed |= IPCEvLayout;
+	if (win != ipclast.win)
+		changed |= IPCEvFocus;
+	if (c && (subs & IPCEvTitle) && (win != ipclast.win || strcmp(c->cold->name, ipclast.name)))
+		changed |= IPCEvTitle;
+	for (i = 0; i < LENGTH(ipcevorder); i++)
+		if (changed & subs & ipcevorder[i]) {
+			ipcevent(ipcevorder[i]);
+			ipcbroadcast(ipcevorder[i]);
+		}
+
+	/* kept current without subscribers too, a new one gets the state
+	 * sent on its own and must not trigger events for everyone else */
+	ipclast.mon = m->num;
+	ipclast.tags = tagset;
+	ipclast.occ = m->occ;
+	ipclast.urg = m->urg;
+	ipclast.lt = m->lt[m->sellt];
+	ipclast.win = win;
+	strcpy(ipclast.name, c ? c->cold->name : "");
+}
+
+void
+ipcget(const char *what)
+{
+	Monitor *m;
+	Client *c;
+	unsigned int i;
+
+	if (!strcmp(what, "monitors")) {
+		ipcprintf("[");
+		for (m = mons; m; m = m->next) {
+			ipcprintf("%s{\"num\":%d,\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d,"
+				"\"selected\":%s,\"tags\":%u,\"layout\":", m == mons ? "" : ",",
+				m->num, m->mx, m->my, m->mw, m->mh,
+				m == selmon ? "true" : "false", m->tagset[m->seltags]);
+			ipcjsonstr(m->ltsymbol);
+			ipcprintf(",\"mfact\":%.2f,\"nmaster\":%d,\"focused\":%lu}",
+				m->mfact, m->nmaster, m->sel ? m->sel->win : None);
+		}
+		ipcprintf("]");
+	} else if (!strcmp(what, "tags")) {
+		m = selmon;
+		ipcprintf("[");
+		for (i = 0; i < LENGTH(tags); i++) {
+			ipcprintf("%s{\"name\":", i ? "," : "");
+			ipcjsonstr(tags[i]);
+			ipcprintf(",\"mask\":%u,\"selected\":%s,\"occupied\":%s,\"urgent\":%s}", 1 << i,
+				m->tagset[m->seltags] & 1 << i ? "true" : "false",
+				m->occ & 1 << i ? "true" : "false",
+				m->urg & 1 << i ? "true" : "false");
+		}
+		ipcprintf("]");
+	} else if (!strcmp(what, "layouts")) {
+		ipcprintf("[");
+		for (i = 0; i < LENGTH(layouts); i++) {
+			ipcprintf("%s{\"index\":%u,\"symbol\":", i ? "," : "", i);
+			ipcjsonstr(layouts[i].symbol);
+			ipcprintf(",\"selected\":%s}",
+				&layouts[i] == selmon->lt[selmon->sellt] ? "true" : "false");
+		}
+		ipcprintf("]");
+	} else if (!strcmp(what, "clients")) {
+		ipcprintf("[");
+		i = 0;
+		for (m = mons; m; m = m->next)
+			for (c = m->clients; c; c = c->next) {
+				ipcprintf("%s{\"window\":%lu,\"name\":", i++ ? "," : "", c->win);
+				ipcjsonstr(c->cold->name);
+				ipcprintf(",\"monitor\":%d,\"tags\":%u,\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d,"
+					"\"floating\":%s,\"fullscreen\":%s,\"urgent\":%s,\"focused\":%s}",
+					m->num, c->tags, c->x, c->y, c->w, c->h,
+					c->isfloating ? "true" : "false",
+					c->isfullscreen ? "true" : "false",
+					c->isurgent ? "true" : "false",
+					c == selmon->sel ? "true" : "false");
+			}
+		ipcprintf("]");
+	} else if (!strcmp(what, "stats")) {
+		ipctiming("{\"spawn_us\"", &spawntime);
+		ipctiming(",\"launch_ms\"", &launchtime);
+		ipcprintf("}");
+	} else {
+		ipcprintf("{\"error\":\"unknown object\"}");
+	}
+}
+
+/* pfd must be the entries filled in by ipcpollfds() */
+void
+ipchandle(struct pollfd *pfd)
+{
+	int i;
+
+	for (i = 0; i < IPCMAXCLIENTS; i++)
+		if (ipcclients[i].fd != -1 && pfd[i + 1].revents)
+			ipcread(&ipcclients[i]);
+	if (pfd[0].revents & POLLIN)
+		ipcaccept();
+}
+
+void
+ipcinit(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	mode_t mask;
+	int i;
+
+	for (i = 0; i < IPCMAXCLIENTS; i++)
+		ipcclients[i].fd = -1;
+	if (strlen(ipcsockpath) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "dwm: ipc socket path too long: %s\n", ipcsockpath);
+		return;
+	}
+	strcpy(addr.sun_path, ipcsockpath);
+	if ((ipcfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) == -1) {
+		fprintf(stderr, "dwm: cannot create ipc socket: %s\n", strerror(errno));
+		return;
+	}
+	unlink(ipcsockpath);
+	mask = umask(077); /* no window where others could connect */
+	i = bind(ipcfd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (i == -1 || listen(ipcfd, 8) == -1) {
+		fprintf(stderr, "dwm: cannot listen on %s: %s\n", ipcsockpath, strerror(errno));
+		close(ipcfd);
+		ipcfd = -1;
+	}
+}
+
+/* appends s as a quoted JSON string, invalid UTF-8 becomes U+FFFD */
+void
+ipcjsonstr(const char *s)
+{
+	char *p;
+	int n;
+
+	ipcreserve(strlen(s) * 6 + 3);
+	p = ipcout + ipclen;
+	*p++ = '"';
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			*p++ = '\\';
+			*p++ = *s;
+		} else if ((unsigned char)*s < 0x20) {
+			p += sprintf(p, "\\u%04x", (unsigned char)*s);
+		} else if ((unsigned char)*s >= 0x80) {
+			if ((n = ipcutf8(s))) {
+				memcpy(p, s, n);
+				p += n;
+				s += n - 1;
+			} else {
+				p += sprintf(p, "\\ufffd");
+			}
+		} else {
+			*p++ = *s;
+		}
+	}
+	*p++ = '"';
+	*p = '\0';
+	ipclen = p - ipcout;
+}
+
+/* fills pfd[0] with the listening socket and pfd[1..] with connections;
+ * unused slots get fd -1, which poll() ignores */
+void
+ipcpollfds(struct pollfd *pfd)
+{
+	int i;
+
+	pfd[0].fd = ipcfd;
+	pfd[0].events = POLLIN;
+	for (i = 0; i < IPCMAXCLIENTS; i++) {
+		pfd[i + 1].fd = ipcclients[i].fd;
+		pfd[i + 1].events = POLLIN;
+	}
+}
+
+void
+ipcprintf(const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+	ipcreserve(n);
+	va_start(ap, fmt);
+	vsnprintf(ipcout + ipclen, ipccap - ipclen, fmt, ap);
+	va_end(ap);
+	ipclen += n;
+}
+
+void
+ipcread(IPCClient *ic)
+{
+	ssize_t n;
+	char *line, *nl;
+
+	n = read(ic->fd, ic->buf + ic->len, sizeof(ic->buf) - 1 - ic->len);
+	if (n <= 0) {
+		if (n == 0 || (errno != EAGAIN && errno != EINTR))
+			ipcdrop(ic);
+		return;
+	}
+	ic->len += n;
+	ic->buf[ic->len] = '\0';
+	for (line = ic->buf; (nl = strchr(line, '\n')); line = nl + 1) {
+		*nl = '\0';
+		ipcrequest(ic, line);
+		if (ic->fd == -1)
+			return;
+	}
+	ic->len -= line - ic->buf;
+	memmove(ic->buf, line, ic->len);
+	if (ic->len == sizeof(ic->buf) - 1) /* line too long */
+		ipcdrop(ic);
+}
+
+void
+ipcrequest(IPCClient *ic, char *line)
+{
+	unsigned long i;
+	char *arg, *end;
+	int n;
+
+	if ((arg = strchr(line, ' ')))
+		*arg++ = '\0';
+	ipclen = 0;
+	if (!strcmp(line, "run") && arg) {
+		line = arg;
+		if ((arg = strchr(line, ' ')))
+			*arg++ = '\0';
+		ipcrun(line, arg);
+	} else if (!strcmp(line, "get") && arg) {
+		ipcget(arg);
+	} else if (!strcmp(line, "block") && arg) {
+		ipcblock(arg);
+	} else if (!strcmp(line, "blocks") && arg) {
+		i = strtoul(arg, &end, 10);
+		if (end == arg || *end || i > 256) {
+			ipcprintf("{\"error\":\"bad count\"}");
+		} else {
+			if (i > nstatusblocks)
+				setstatusblock(i - 1, 0, "", 0);
+			n = i != nstatusblocks;
+			nstatusblocks = i;
+			redrawstatus(n * 2, 0);
+			ipcprintf("{\"ok\":true}");
+		}
+	} else if (!strcmp(line, "statuspid") && arg) {
+		i = strtoul(arg, &end, 10);
+		if (end == arg || *end || !i) {
+			ipcprintf("{\"error\":\"bad pid\"}");
+		} else {
+			setstatuspid(i);
+			ipcprintf("{\"ok\":true}");
+		}
+	} else if (!strcmp(line, "subscribe") && arg) {
+		i = ipcsubscribe(arg) & ~ic->subs;
+		ic->subs |= i;
+		ipcprintf("{\"ok\":true}");
+		if (!ipcsend(ic))
+			return;
+		/* the current state of the new events, to this connection only */
+		for (n = 0; n < LENGTH(ipcevorder); n++) {
+			if (!(i & ipcevorder[n]) || (ipcevorder[n] == IPCEvTitle && !selmon->sel))
+				continue;
+			ipcevent(ipcevorder[n]);
+			if (!ipcsend(ic))
+				return;
+		}
+		return;
+	} else {
+		ipcprintf("{\"error\":\"unknown request\"}");
+	}
+	ipcsend(ic);
+}
+
+/* makes room for n more bytes and a terminating nul in ipcout */
+void
+ipcreserve(size_t n)
+{
+	if (ipclen + n + 2 <= ipccap)
+		return;
+	ipccap = (ipclen + n + 2) * 2;
+	if (!(ipcout = realloc(ipcout, ipccap)))
+		die("realloc:");
+}
+
+void
+ipcrun(char *name, char *arg)
+{
+	const char *shcmd[] = { "/bin/sh", "-c", NULL, NULL };
+	const IPCCommand *cmd = NULL;
+	unsigned int i;
+	char *end = NULL;
+	Arg a = {0};
+
+	for (i = 0; i < LENGTH(ipccommands) && !cmd; i++)
+		if (!strcmp(ipccommands[i].name, name))
+			cmd = &ipccommands[i];
+	if (!cmd) {
+		ipcprintf("{\"error\":\"unknown function\"}");
+		return;
+	}
+	switch (cmd->argtype) {
+	case IPCArgInt:   if (arg) a.i = strtol(arg, &end, 0); break;
+	case IPCArgUint:  if (arg) a.ui = strtoul(arg, &end, 0); break;
+	case IPCArgFloat: if (arg) a.f = strtof(arg, &end); break;
+	case IPCArgLayout:
+		if (arg && (i = strtoul(arg, &end, 0)) < LENGTH(layouts))
+			a.v = &layouts[i];
+		else if (arg)
+			end = arg;
+		break;
+	case IPCArgShell:
+		shcmd[2] = arg;
+		a.v = shcmd;
+		break;
+	}
+	if ((arg && end && (end == arg || *end)) || (cmd->argtype == IPCArgShell && !arg)) {
+		ipcprintf("{\"error\":\"bad argument\"}");
+		return;
+	}
+	cmd->func(&a);
+	ipcprintf("{\"ok\":true}");
+}
+
+/* writes the message in ipcout followed by a newline; drops the connection
+ * if it cannot take all of it right away */
+int
+ipcsend(IPCClient *ic)
+{
+	size_t off = 0;
+	ssize_t n;
+
+	ipcreserve(1);
+	ipcout[ipclen] = '\n';
+	while (off < ipclen + 1) {
+		if ((n = send(ic->fd, ipcout + off, ipclen + 1 - off, MSG_NOSIGNAL)) == -1) {
+			if (errno == EINTR)
+				continue;
+			ipcdrop(ic);
+			return 0;
+		}
+		off += n;
+	}
+	return 1;
+}
+
+unsigned int
+ipcsubscribe(char *events)
+{
+	static const struct { const char *name; unsigned int ev; } names[] = {
+		{ "focus", IPCEvFocus }, { "title", IPCEvTitle }, { "tag", IPCEvTag },
+		{ "layout", IPCEvLayout }, { "monitor", IPCEvMonitor }, { "all", ~0u },
+	};
+	unsigned int i, subs = 0;
+	char *ev;
+
+	for (ev = strtok(events, " "); ev; ev = strtok(NULL, " "))
+		for (i = 0; i < LENGTH(names); i++)
+			if (!strcmp(ev, names[i].name))
+				subs |= names[i].ev;
+	return subs;
+}
+
+void
+ipctiming(const char *name, const Timing *t)
+{
+	ipcprintf("%s:{\"count\":%lu,\"last\":%lld,\"avg\":%lld,\"max\":%lld}", name,
+		t->n, t->last, t->n ? t->total / (long long)t->n : 0, t->max);
+}
+
+/* length of the valid UTF-8 sequence s starts with, 0 if there is none */
+int
+ipcutf8(const char *s)
+{
+	const unsigned char *u = (const unsigned char *)s;
+	unsigned long c;
+	int n, i;
+
+	if (u[0] < 0x80)
+		return 1;
+	else if ((u[0] & 0xe0) == 0xc0)
+		n = 2, c = u[0] & 0x1f;
+	else if ((u[0] & 0xf0) == 0xe0)
+		n = 3, c = u[0] & 0x0f;
+	else if ((u[0] & 0xf8) == 0xf0)
+		n = 4, c = u[0] & 0x07;
+	else
+		return 0;
+	for (i = 1; i < n; i++) {
+		if ((u[i] & 0xc0) != 0x80) /* also stops at the terminating nul */
+			return 0;
+		c = c << 6 | (u[i] & 0x3f);
+	}
+	/* overlong forms, surrogates and code points past U+10FFFF */
+	if (c < (n == 2 ? 0x80 : n == 3 ? 0x800 : 0x10000)
+	|| (c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff)
+		return 0;
+	return n;
+}
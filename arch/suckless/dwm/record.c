@@ -0,0 +1,391 @@
+/* Event recording and replay, included by dwm.c after config.h.
+ *
+ * "run record" starts writing every X event dwm handles to recordpath and
+ * stops again on the next call. "dwm -r <file>" replays such a trace on an
+ * otherwise idle X server (Xvfb or Xephyr) as fast as it can and prints how
+ * many events of each type went through the handlers along with wall clock
+ * and CPU time, so that two builds can be compared on the same session.
+ *
+ * A trace is a header with the recording dwm's root and bar windows and the
+ * names of its atoms, followed by one record per event: the microseconds
+ * since the previous record, the event type and the bytes of the matching
+ * Xlib event structure. Traces are only portable between machines with the
+ * same Xlib ABI.
+ *
+ * Replies are not recorded. Windows the trace refers to are replaced by empty
+ * dummy windows on the replay server, so properties, pids and sizes asked of
+ * the server are those of the dummies, rules and swallowing never match and
+ * commands are not spawned. Events dwm causes itself during a replay are
+ * dropped, the trace already holds the ones the original session saw.
+ *
+ * XSync alarm events are handled before recording and are not in the trace.
+ * Their type depends on the server's extension base, and the dummies have no
+ * sync counter, so a replay never paces resizes on sync requests and does not
+ * measure the time clients take to answer them.
+ */
+
+typedef struct {
+	unsigned long from, to;
+} RecordMap;
+
+static int checkmotion(XEvent *ev, int *released);
+static void nextevent(long mask, XEvent *ev);
+static void recordevent(XEvent *ev);
+static unsigned long recordmap(RecordMap **m, size_t *n, unsigned long from, unsigned long to);
+static size_t recordsize(int type);
+static void replay(const char *path);
+static unsigned long replayatom(unsigned long a);
+static int replayheader(void);
+static int replaynext(XEvent *ev);
+static XEvent *replaypeek(void);
+static Window replaywin(Window w);
+
+static const char recordmagic[8] = "dwmrec1\n";
+static FILE *recordfp, *replayfp;
+static long long recordat;     /* nowus() of the last record */
+static long long replayspan;   /* µs covered by the records read so far */
+static unsigned long replayn[LASTEvent];
+static RecordMap *replaywins, *replayatoms;
+static size_t nreplaywins, nreplayatoms;
+static XEvent replaybuf;
+static int replayhave;         /* replaybuf holds the next record */
+
+/* XCheckIfEvent(motionpending) for the mouse loops, recorded and replayed */
+int
+checkmotion(XEvent *ev, int *released)
+{
+	XEvent *next;
+
+	if (replayfp) {
+		if (!(next = replaypeek()) || !motionpending(dpy, next, (XPointer)released))
+			return 0;
+		return replaynext(ev);
+	}
+	if (!XCheckIfEvent(dpy, ev, motionpending, (XPointer)released))
+		return 0;
+	if (recordfp)
+		recordevent(ev);
+	return 1;
+}
+
+/* XMaskEvent for the mouse loops, recorded and replayed */
+void
+nextevent(long mask, XEvent *ev)
+{
+	if (replayfp) {
+		if (!replaynext(ev)) { /* the trace ended mid drag */
+			memset(ev, 0, sizeof(*ev));
+			ev->type = ButtonRelease;
+		}
+		return;
+	}
+	XMaskEvent(dpy, mask, ev);
+	if (recordfp)
+		recordevent(ev);
+}
+
+void
+record(const Arg *arg)
+{
+	Monitor *m;
+	Window w[16];
+	Atom a[WMLast + NetLast];
+	char *names[WMLast + NetLast];
+	uint32_t n = 0, i, len;
+
+	if (replayfp)
+		return;
+	if (recordfp) {
+		fclose(recordfp);
+		recordfp = NULL;
+		return;
+	}
+	if (!(recordfp = fopen(recordpath, "w"))) {
+		fprintf(stderr, "dwm: cannot record to '%s': %s\n", recordpath, strerror(errno));
+		return;
+	}
+	setvbuf(recordfp, NULL, _IOFBF, 1 << 16);
+	w[n++] = root;
+	for (m = mons; m && n < LENGTH(w); m = m->next)
+		w[n++] = m->barwin;
+	fwrite(recordmagic, 1, sizeof(recordmagic), recordfp);
+	fwrite(&n, sizeof(n), 1, recordfp);
+	fwrite(w, sizeof(Window), n, recordfp);
+	memcpy(a, wmatom, sizeof(wmatom));
+	memcpy(a + WMLast, netatom, sizeof(netatom));
+	n = 0;
+	if (XGetAtomNames(dpy, a, LENGTH(a), names))
+		n = LENGTH(a);
+	fwrite(&n, sizeof(n), 1, recordfp);
+	for (i = 0; i < n; i++) { /* atoms the events may carry, by name */
+		len = strlen(names[i]);
+		fwrite(&a[i], sizeof(Atom), 1, recordfp);
+		fwrite(&len, sizeof(len), 1, recordfp);
+		fwrite(names[i], 1, len, recordfp);
+		XFree(names[i]);
+	}
+	recordat = nowus();
+}
+
+void
+recordevent(XEvent *ev)
+{
+	long long now = nowus();
+	uint32_t dt = MIN(now - recordat, (long long)UINT32_MAX);
+	unsigned char type = ev->type;
+
+	recordat = now;
+	if (!fwrite(&dt, sizeof(dt), 1, recordfp)
+	|| !fwrite(&type, 1, 1, recordfp)
+	|| !fwrite(ev, recordsize(type), 1, recordfp)) {
+		fprintf(stderr, "dwm: recording stopped: %s\n", strerror(errno));
+		fclose(recordfp);
+		recordfp = NULL;
+	}
+}
+
+/* adds the pair, or looks up from when to is 0 */
+unsigned long
+recordmap(RecordMap **m, size_t *n, unsigned long from, unsigned long to)
+{
+	size_t i;
+
+	for (i = 0; i < *n; i++)
+		if ((*m)[i].from == from) {
+			if (to)
+				(*m)[i].to = to;
+			return (*m)[i].to;
+		}
+	if (!to)
+		return 0;
+	if (!(*n & (*n + 1)) && !(*m = realloc(*m, (2 * *n + 1) * sizeof(RecordMap))))
+		die("realloc:");
+	(*m)[*n].from = from;
+	(*m)[(*n)++].to = to;
+	return to;
+}
+
+/* bytes of the event structure that matter for type */
+size_t
+recordsize(int type)
+{
+	switch (type) {
+	case KeyPress:
+	case KeyRelease:       return sizeof(XKeyEvent);
+	case ButtonPress:
+	case ButtonRelease:    return sizeof(XButtonEvent);
+	case MotionNotify:     return sizeof(XMotionEvent);
+	case EnterNotify:
+	case LeaveNotify:      return sizeof(XCrossingEvent);
+	case FocusIn:
+	case FocusOut:         return sizeof(XFocusChangeEvent);
+	case Expose:           return sizeof(XExposeEvent);
+	case DestroyNotify:    return sizeof(XDestroyWindowEvent);
+	case UnmapNotify:      return sizeof(XUnmapEvent);
+	case MapRequest:       return sizeof(XMapRequestEvent);
+	case ConfigureNotify:  return sizeof(XConfigureEvent);
+	case ConfigureRequest: return sizeof(XConfigureRequestEvent);
+	case PropertyNotify:   return sizeof(XPropertyEvent);
+	case ClientMessage:    return sizeof(XClientMessageEvent);
+	case MappingNotify:    return sizeof(XMappingEvent);
+	default:               return sizeof(XEvent);
+	}
+}
+
+void
+replay(const char *path)
+{
+	static const char *names[LASTEvent] = {
+		[KeyPress] = "KeyPress", [ButtonPress] = "ButtonPress",
+		[ButtonRelease] = "ButtonRelease", [MotionNotify] = "MotionNotify",
+		[EnterNotify] = "EnterNotify", [FocusIn] = "FocusIn",
+		[Expose] = "Expose", [DestroyNotify] = "DestroyNotify",
+		[UnmapNotify] = "UnmapNotify", [MapRequest] = "MapRequest",
+		[ConfigureNotify] = "ConfigureNotify",
+		[ConfigureRequest] = "ConfigureRequest",
+		[PropertyNotify] = "PropertyNotify", [ClientMessage] = "ClientMessage",
+		[MappingNotify] = "MappingNotify"
+	};
+	struct timespec cpu0, cpu1;
+	long long wall;
+	unsigned long total = 0;
+	XEvent ev;
+	size_t i;
+
+	if (!(replayfp = fopen(path, "r")))
+		die("dwm: cannot open '%s':", path);
+	if (!replayheader())
+		die("dwm: '%s' is not a dwm trace", path);
+	XSync(dpy, False);
+	while (XPending(dpy))
+		XNextEvent(dpy, &ev);
+	wall = nowus();
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu0);
+	while (running && replaynext(&ev)) {
+		if (handler[ev.type])
+			handler[ev.type](&ev);
+		if (ev.type == DestroyNotify) {
+			XDestroyWindow(dpy, ev.xdestroywindow.window);
+			for (i = 0; i < nreplaywins; i++)
+				if (replaywins[i].to == ev.xdestroywindow.window) {
+					replaywins[i] = replaywins[--nreplaywins];
+					break; /* window ids are unique */
+				}
+		}
+		if (screenat)
+			applyscreen();
+		if (clientlistdirty)
+			writeclientlist();
+		/* drop what dwm caused itself, the trace has those already */
+		XSync(dpy, False);
+		while (XPending(dpy))
+			XNextEvent(dpy, &ev);
+	}
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu1);
+	wall = nowus() - wall;
+	for (i = 0; i < LASTEvent; i++) {
+		if (!replayn[i])
+			continue;
+		total += replayn[i];
+		if (names[i])
+			fprintf(stderr, "%-18s %lu\n", names[i], replayn[i]);
+		else
+			fprintf(stderr, "%-18d %lu\n", (int)i, replayn[i]);
+	}
+	fprintf(stderr, "dwm: replayed %lu events recorded over %lld ms in %lld ms, %lld ms cpu\n",
+		total, replayspan / 1000, wall / 1000,
+		((cpu1.tv_sec - cpu0.tv_sec) * 1000000000LL + cpu1.tv_nsec - cpu0.tv_nsec) / 1000000);
+	fclose(replayfp);
+	replayfp = NULL;
+	free(replaywins);
+	free(replayatoms);
+}
+
+/* the replay server's atom for one of the recording server's */
+unsigned long
+replayatom(unsigned long a)
+{
+	unsigned long r;
+
+	if (a <= XA_LAST_PREDEFINED)
+		return a;
+	return (r = recordmap(&replayatoms, &nreplayatoms, a, 0)) ? r : None;
+}
+
+int
+replayheader(void)
+{
+	Monitor *m;
+	Window w[16];
+	Atom a;
+	char magic[sizeof(recordmagic)], name[256];
+	uint32_t n, i, len;
+
+	if (fread(magic, 1, sizeof(magic), replayfp) != sizeof(magic)
+	|| memcmp(magic, recordmagic, sizeof(magic))
+	|| fread(&n, sizeof(n), 1, replayfp) != 1 || n < 1 || n > LENGTH(w)
+	|| fread(w, sizeof(Window), n, replayfp) != n)
+		return 0;
+	recordmap(&replaywins, &nreplaywins, w[0], root);
+	for (i = 1, m = mons; i < n && m; i++, m = m->next)
+		recordmap(&replaywins, &nreplaywins, w[i], m->barwin);
+	if (fread(&n, sizeof(n), 1, replayfp) != 1)
+		return 0;
+	for (i = 0; i < n; i++) {
+		if (fread(&a, sizeof(a), 1, replayfp) != 1
+		|| fread(&len, sizeof(len), 1, replayfp) != 1 || len >= sizeof(name)
+		|| fread(name, 1, len, replayfp) != len)
+			return 0;
+		name[len] = '\0';
+		recordmap(&replayatoms, &nreplayatoms, a, XInternAtom(dpy, name, False));
+	}
+	return 1;
+}
+
+/* reads the next record and points its windows and atoms at this server */
+int
+replaynext(XEvent *ev)
+{
+	if (!replaypeek())
+		return 0;
+	*ev = replaybuf;
+	replayhave = 0;
+	replayn[ev->type]++;
+	return 1;
+}
+
+XEvent *
+replaypeek(void)
+{
+	XEvent *ev = &replaybuf;
+	uint32_t dt;
+	unsigned char type;
+
+	if (replayhave)
+		return ev;
+	memset(ev, 0, sizeof(*ev));
+	if (fread(&dt, sizeof(dt), 1, replayfp) != 1
+	|| fread(&type, 1, 1, replayfp) != 1 || type >= LASTEvent
+	|| fread(ev, recordsize(type), 1, replayfp) != 1)
+		return NULL;
+	replayspan += dt;
+	ev->type = type;
+	ev->xany.display = dpy;
+	ev->xany.window = replaywin(ev->xany.window);
+	switch (type) {
+	case KeyPress:
+	case KeyRelease:
+	case ButtonPress:
+	case ButtonRelease:
+	case MotionNotify:
+	case EnterNotify:
+	case LeaveNotify:
+		/* root and subwindow sit at the same place in all of these */
+		ev->xbutton.root = replaywin(ev->xbutton.root);
+		ev->xbutton.subwindow = replaywin(ev->xbutton.subwindow);
+		break;
+	case DestroyNotify:
+		ev->xdestroywindow.window = replaywin(ev->xdestroywindow.window);
+		break;
+	case UnmapNotify:
+		ev->xunmap.window = replaywin(ev->xunmap.window);
+		break;
+	case MapRequest:
+		ev->xmaprequest.window = replaywin(ev->xmaprequest.window);
+		break;
+	case ConfigureNotify:
+		ev->xconfigure.window = replaywin(ev->xconfigure.window);
+		ev->xconfigure.above = replaywin(ev->xconfigure.above);
+		break;
+	case ConfigureRequest:
+		ev->xconfigurerequest.window = replaywin(ev->xconfigurerequest.window);
+		ev->xconfigurerequest.above = replaywin(ev->xconfigurerequest.above);
+		break;
+	case PropertyNotify:
+		ev->xproperty.atom = replayatom(ev->xproperty.atom);
+		break;
+	case ClientMessage:
+		ev->xclient.message_type = replayatom(ev->xclient.message_type);
+		if (ev->xclient.message_type == netatom[NetWMState]) {
+			ev->xclient.data.l[1] = replayatom(ev->xclient.data.l[1]);
+			ev->xclient.data.l[2] = replayatom(ev->xclient.data.l[2]);
+		}
+		break;
+	}
+	replayhave = 1;
+	return ev;
+}
+
+/* the dummy standing in for a window of the recording server */
+Window
+replaywin(Window w)
+{
+	Window r;
+
+	if (!w)
+		return None;
+	if ((r = recordmap(&replaywins, &nreplaywins, w, 0)))
+		return r;
+	r = XCreateSimpleWindow(dpy, root, 0, 0, 320, 240, 0, 0, 0);
+	return recordmap(&replaywins, &nreplaywins, w, r);
+}
@@ -0,0 +1,84 @@
+/* Timeline of dwm's work, included by dwm.c after config.h when built with
+ * -DTIMELINE (see config.mk).
+ *
+ * SPANBEGIN/SPANEND mark the start and end of manage, arrange, each layout,
+ * drawbar, restack, focus and the X round-trips on those paths, ASYNCBEGIN/
+ * ASYNCEND the time a client takes to answer a sync request. They land in a
+ * ring buffer holding the last TIMELINESIZE marks; SIGUSR1 writes it to
+ * timelinepath as Chrome trace event JSON, which chrome://tracing and
+ * ui.perfetto.dev open:
+ *
+ *   pkill -USR1 -x dwm
+ */
+
+#define TIMELINESIZE 32768
+
+typedef struct {
+	const char *name;
+	long long ts;          /* µs, CLOCK_MONOTONIC */
+	unsigned long id;      /* pairs async marks */
+	char ph;               /* B, E, b or e */
+} Mark;
+
+static void sigusr1(int unused);
+static void timelineadd(const char *name, char ph, unsigned long id);
+static void timelinewrite(void);
+
+static Mark marks[TIMELINESIZE];
+static unsigned long nmarks;   /* ever added, the ring holds the last ones */
+static volatile sig_atomic_t timelinewanted;
+
+void
+sigusr1(int unused)
+{
+	timelinewanted = 1;
+}
+
+void
+timelineadd(const char *name, char ph, unsigned long id)
+{
+	Mark *k = &marks[nmarks++ % TIMELINESIZE];
+
+	k->name = name;
+	k->ts = nowus();
+	k->id = id;
+	k->ph = ph;
+}
+
+void
+timelinewrite(void)
+{
+	FILE *fp;
+	Mark *k;
+	const char *s;
+	unsigned long i = nmarks > TIMELINESIZE ? nmarks - TIMELINESIZE : 0;
+	int depth = 0, first = 1;
+
+	timelinewanted = 0;
+	if (!(fp = fopen(timelinepath, "w"))) {
+		fprintf(stderr, "dwm: cannot write '%s': %s\n", timelinepath, strerror(errno));
+		return;
+	}
+	fputs("{\"traceEvents\":[", fp);
+	for (; i < nmarks; i++) {
+		k = &marks[i % TIMELINESIZE];
+		/* the ring may start inside spans, their ends would be unmatched */
+		if (k->ph == 'B')
+			depth++;
+		else if (k->ph == 'E' && !depth--) {
+			depth = 0;
+			continue;
+		}
+		fprintf(fp, "%s\n{\"name\":\"", first ? "" : ",");
+		for (s = k->name; *s; s++) /* layout symbols may hold backslashes */
+			fprintf(fp, *s == '"' || *s == '\\' ? "\\%c" : "%c", *s);
+		fprintf(fp, "\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":%d,\"tid\":1", k->ph, k->ts, (int)getpid());
+		if (k->ph == 'b' || k->ph == 'e')
+			fprintf(fp, ",\"cat\":\"sync\",\"id\":\"0x%lx\"", k->id);
+		fputc('}', fp);
+		first = 0;
+	}
+	fputs("\n]}\n", fp);
+	if (fclose(fp) == EOF)
+		fprintf(stderr, "dwm: cannot write '%s': %s\n", timelinepath, strerror(errno));
+}
@@ -34,3 +34,85 @@ ecalloc(size_t nmemb, size_t size)
 		die("calloc:");
 	return p;
 }
+
+#define POOLSLAB 32 /* objects per slab */
+
+/* precedes every pooled object; gen is bumped on both alloc and free, so it
+ * is odd while the object is live and never repeats for the slot */
+typedef union PoolSlot PoolSlot;
+union PoolSlot {
+	struct {
+		unsigned int gen;
+		PoolSlot *next;
+	} h;
+	long double align;
+};
+
+static size_t
+poolstride(const Pool *pool)
+{
+	return sizeof(PoolSlot) * (1 + (pool->size + sizeof(PoolSlot) - 1) / sizeof(PoolSlot));
+}
+
+void *
+poolalloc(Pool *pool)
+{
+	PoolSlot *s, *slab;
+
+	if ((s = pool->free)) {
+		pool->free = s->h.next;
+	} else {
+		if (!pool->left) {
+			slab = ecalloc(1, sizeof(PoolSlot) + POOLSLAB * poolstride(pool));
+			slab->h.next = pool->slabs;
+			pool->slabs = slab;
+			pool->next = (char *)(slab + 1);
+			pool->left = POOLSLAB;
+		}
+		s = (PoolSlot *)pool->next;
+		pool->next += poolstride(pool);
+		pool->left--;
+	}
+	s->h.gen++;
+	memset(s + 1, 0, pool->size);
+	return s + 1;
+}
+
+void
+pooldestroy(Pool *pool)
+{
+	PoolSlot *slab;
+
+	while ((slab = pool->slabs)) {
+		pool->slabs = slab->h.next;
+		free(slab);
+	}
+	pool->free = NULL;
+	pool->next = NULL;
+	pool->left = 0;
+}
+
+void
+poolfree(Pool *pool, void *p)
+{
+	PoolSlot *s = (PoolSlot *)p - 1;
+
+	s->h.gen++;
+	s->h.next = pool->free;
+	pool->free = s;
+}
+
+/* the object r refers to, or NULL once it has been freed */
+void *
+poolget(Ref r)
+{
+	return r.p && ((PoolSlot *)r.p - 1)->h.gen == r.gen ? r.p : NULL;
+}
+
+Ref
+poolref(void *p)
+{
+	Ref r = { p, p ? ((PoolSlot *)p - 1)->h.gen : 0 };
+
+	return r;
+}
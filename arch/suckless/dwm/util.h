@@ -6,3 +6,24 @@
 
 void die(const char *fmt, ...);
 void *ecalloc(size_t nmemb, size_t size);
+
+/* fixed-size objects carved from slabs, recycled through a free list; the
+ * slot memory is never returned, so a Ref can be checked after the free */
+typedef struct {
+	size_t size;          /* object size */
+	void *free;           /* freed slots */
+	void *slabs;          /* every slab, for pooldestroy */
+	char *next;           /* unused slots of the newest slab */
+	unsigned int left;
+} Pool;
+
+typedef struct {
+	void *p;
+	unsigned int gen;     /* generation of p's slot when the Ref was taken */
+} Ref;
+
+void *poolalloc(Pool *pool);
+void pooldestroy(Pool *pool);
+void poolfree(Pool *pool, void *p);
+void *poolget(Ref r);
+Ref poolref(void *p);
@@ -462,8 +462,10 @@ deck(Monitor *m)
 			resize(c, mx, my, mw - (2*c->bw), mh * (c->cfact / mfacts) + (i < mrest ? 1 : 0) - (2*c->bw), 0);
 			my += HEIGHT(c) + ih;
 		} else {
-			resize(c, sx, sy, sw - (2*c->bw), sh - (2*c->bw), 0);
+			/* only the top of the deck is shown, defer the others */
+			setpending(c, sx, sy, sw - (2*c->bw), sh - (2*c->bw));
 		}
+	showpending(m);
 }
 
 /*